@@ -0,0 +1,85 @@
+#include "allay/mlog/mlog.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+// 统计全局堆的分配次数，稳定状态下每次写日志都不应当分配
+namespace {
+
+std::atomic<std::size_t> allocation_count{0};
+
+bool check(bool cond, const std::string &msg) {
+    if (!cond) { std::cerr << "mlog_alloc_demo: check failed: " << msg << '\n'; }
+    return cond;
+}
+
+void log_some(mlog::LoggerHandle logger, int round) {
+    const char *c_str = "c string";
+    for (int i = 0; i < 100; ++i) {
+        mlog::info(logger) << " int " << i << " double " << 2.5 << ' ' << c_str
+                           << '\n';
+        MLOG_WARN(logger) << "macro " << round << '\n';
+        mlog::error(logger) << MLOG_STAMP << " stamp\n";
+        mlog::debug(logger) << " filtered\n";
+        mlog::info(logger).kv("user", i).kv("ok", true).msg("structured");
+        *logger << "direct " << i << '\n';
+    }
+}
+
+// 第一轮预热线程局部的缓冲区，之后的轮次不应当有任何分配
+bool test(const std::string &name, mlog::LoggerHandle logger) {
+    log_some(logger, 0);
+    log_some(logger, 1);
+
+    const std::size_t before = allocation_count.load();
+    log_some(logger, 2);
+    const std::size_t after = allocation_count.load();
+
+    return check(after == before, name + ": " + std::to_string(after - before)
+                                      + " allocations");
+}
+
+}  // namespace
+
+// 计数的分配函数直接使用malloc和free，gcc无法看出它们是配对的
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, std::size_t /*size*/) noexcept {
+    ::operator delete(ptr);
+}
+
+int main() {
+    mlog::init(PREFIX + std::string("/.mlog/"));
+    mlog::set_level_info();
+
+    mlog::create_logger("text").link_file_trunc("text.log");
+    mlog::create_logger("pattern")
+        .set_pattern("%Y-%m-%d %T.%e [%l] {%n} %t %s ")
+        .link_file_trunc("pattern.log");
+    mlog::create_logger("json")
+        .set_encoding(mlog::Encoding::JSON)
+        .link_file_trunc("json.log");
+
+    bool ok = test("text", mlog::get_logger("text"));
+    ok = test("pattern", mlog::get_logger("pattern")) && ok;
+    ok = test("json", mlog::get_logger("json")) && ok;
+
+    mlog::init_async(1024, mlog::OverflowPolicy::BLOCK);
+    ok = test("async text", mlog::get_logger("text")) && ok;
+    ok = test("async json", mlog::get_logger("json")) && ok;
+    mlog::shutdown_async();
+
+    return ok ? 0 : 1;
+}
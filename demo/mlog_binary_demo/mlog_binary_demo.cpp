@@ -0,0 +1,114 @@
+#include "allay/mlog/mlog.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+bool check(bool cond, const std::string &msg) {
+    if (!cond) { std::cerr << "mlog_binary_demo: check failed: " << msg << '\n'; }
+    return cond;
+}
+
+std::vector<std::string> decode_lines(const std::string &file_name) {
+    std::ifstream fin(MLogFileManager::get_path_prefix() + file_name,
+                      std::ios_base::binary);
+    std::ostringstream oss;
+    std::vector<std::string> lines;
+    if (!MLogBinary::decode(fin, oss)) return lines;
+
+    std::istringstream iss(oss.str());
+    std::string line;
+    while (std::getline(iss, line)) lines.push_back(line);
+    return lines;
+}
+
+bool ends_with(const std::string &str, const std::string &suffix) {
+    return str.size() >= suffix.size()
+           && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+void produce(int n) {
+    const std::string user = "alice";
+    for (int i = 0; i < n; ++i) {
+        MLOG_BINARY_INFO("bin", "request {} from {} took {} us", i, user,
+                         0.5 * i);
+        MLOG_BINARY_DEBUG("bin", "debug {}", i);  // 被日志等级过滤
+    }
+    MLOG_BINARY_WARN("bin", "ok={} c={} {{literal}} {}", true, 'x',
+                     static_cast<std::uint64_t>(1) << 40U);
+}
+
+bool check_file(const std::string &file_name, int n) {
+    auto lines = decode_lines(file_name);
+
+    bool ok = check(lines.size() == static_cast<std::size_t>(n) + 2,
+                    "lines of " + file_name);
+    ok = ok && check(lines.front().find("MLOG START") != std::string::npos,
+                     "text record in " + file_name);
+    for (int i = 0; ok && i < n; ++i) {
+        std::ostringstream expected;
+        expected << " request " << i << " from alice took " << 0.5 * i
+                 << " us";
+        const std::string &line = lines[static_cast<std::size_t>(i) + 1];
+        ok = check(line.rfind("[INFO]{bin}[", 0) == 0
+                       && ends_with(line, expected.str()),
+                   "decoded line: " + line);
+    }
+    return ok
+           && check(lines.back().rfind("[WARN]{bin}[", 0) == 0
+                        && ends_with(lines.back(),
+                                     " ok=true c=x {literal} 1099511627776"),
+                    "decoded line: " + lines.back());
+}
+
+// 同步写入二进制日志
+bool test_sync() {
+    mlog::get_logger("bin").link_file_binary("sync.bin");
+    produce(100);
+    mlog::get_logger("bin").flush();
+    return check_file("sync.bin", 100);
+}
+
+// 异步写入二进制日志
+bool test_async() {
+    mlog::get_logger("bin").link_file_binary("async.bin");
+    mlog::init_async(1024, mlog::OverflowPolicy::BLOCK);
+    produce(1000);
+    mlog::get_logger("bin").flush();
+    mlog::shutdown_async();
+    return check_file("async.bin", 1000);
+}
+
+// 非二进制模式的logger直接格式化，结果与解码一致
+bool test_text() {
+    mlog::create_logger("text")
+        .set_format(mlog::Format::NONE)
+        .link_file_trunc("text.log")
+        .lock();
+    MLOG_BINARY_INFO("text", "value {} and {}", 42, "str");
+    mlog::get_logger("text").flush();
+
+    std::ifstream fin(MLogFileManager::get_path_prefix() + "text.log");
+    std::string line;
+    std::getline(fin, line);  // MLOG START
+    std::getline(fin, line);
+    return check(line == " value 42 and str", "text fallback: " + line);
+}
+
+}  // namespace
+
+int main() {
+    mlog::init(PREFIX + std::string("/.mlog/"));
+    mlog::set_level_info();
+
+    mlog::create_logger("bin").set_format(mlog::Format::LEVEL_SIGNATURE_TIME);
+
+    bool ok = test_sync();
+    ok = test_async() && ok;
+    ok = test_text() && ok;
+
+    return ok ? 0 : 1;
+}
@@ -2,6 +2,13 @@
 
 #include "allay/mlog/mlog.hpp"
 
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <regex>
+#include <sstream>
+#include <thread>
+
 namespace {
 
 void test(const std::string &name) {
@@ -24,6 +31,13 @@ void prepare() {
         .enable_file_and_cout()
         .lock();
 
+    mlog::create_logger("micro")
+        .set_format(mlog::Format::LEVEL_TIME)
+        .set_time_precision(mlog::TimePrecision::MICRO)
+        .link_file_trunc("micro.log")
+        .enable_file_and_cout()
+        .lock();
+
     mlog::create_logger("d").link_file_trunc("d.log");
     mlog::create_logger("e").link_file_trunc("e.log");
     mlog::create_logger("f").link_file_trunc("f.log");
@@ -40,6 +54,198 @@ void test2() {
     }
 }
 
+void test3() {
+#ifdef MLOG_HAS_FORMAT
+    mlog::info("B", "format {} + {} = {}", 1, 2, 1 + 2);
+    mlog::warn("B", "pi = {:.3f}", 3.14159);
+    mlog::out("cout", "{:>8}|{:<8}|", "right", "left");
+#endif
+}
+
+// 被过滤的语句不会对参数求值
+bool test4() {
+    int evaluated = 0;
+    auto expensive = [&evaluated]() { return ++evaluated; };
+
+    MLOG_DEBUG("cout") << "value = " << expensive() << '\n';
+    if (evaluated != 0) return false;
+
+    MLOG_INFO("cout") << "value = " << expensive() << '\n';
+    return evaluated == 1;
+}
+
+// 每个logger单独的日志等级
+bool test5() {
+    int evaluated = 0;
+    auto expensive = [&evaluated]() { return ++evaluated; };
+
+    mlog::set_level("d", mlog::Level::debug);
+    mlog::set_level("e", mlog::Level::error);
+
+    MLOG_DEBUG("d") << "debug on d, value = " << expensive() << '\n';
+    MLOG_WARN("e") << "warn on e, value = " << expensive() << '\n';
+    const bool ok = (evaluated == 1) && mlog::debug("d").active()
+                    && !mlog::debug("f").active() && !mlog::warn("e").active()
+                    && mlog::error("e").active();
+
+    // 恢复后只有全局等级起作用，debug又被宏直接过滤
+    mlog::reset_level("d");
+    mlog::reset_level("e");
+    MLOG_DEBUG("d") << "value = " << expensive() << '\n';
+
+    return ok && evaluated == 1 && mlog::warn("e").active();
+}
+
+// 保存下来的句柄与名称指向同一个logger
+bool test6() {
+    mlog::LoggerHandle handle = mlog::get_logger("d");
+
+    mlog::info(handle) << " info by handle\n";
+    MLOG_WARN(handle) << "warn by handle\n";
+
+    return &handle.get() == &mlog::get_logger(std::string{"d"})
+           && mlog::info(handle).active() && !mlog::debug(handle).active();
+}
+
+// 冲刷策略：info记录和std::endl都留在缓冲区，warn记录立即连同之前的内容一起写出
+// 之后分别按条数和时间间隔冲刷
+bool test7() {
+    const std::string file_name = "flush.log";
+    const auto on_disk = [&file_name](const std::string &text) {
+        std::ifstream fin(MLogFileManager::get_path_prefix() + file_name);
+        const std::string content{std::istreambuf_iterator<char>(fin),
+                                  std::istreambuf_iterator<char>()};
+        return content.find(text) != std::string::npos;
+    };
+
+    mlog::FlushPolicy policy;
+    policy.level = mlog::Level::warn;
+    policy.on_endl = false;
+    policy.buffer_size = 1 << 16;
+    mlog::create_logger("flush").set_flush_policy(policy).link_file_trunc(
+        file_name);
+
+    mlog::info("flush") << " buffered" << std::endl;
+    const bool buffered = !on_disk("buffered");
+    mlog::warn("flush") << " urgent\n";
+    const bool flushed = on_disk("buffered") && on_disk("urgent");
+
+    // 每3条记录冲刷一次
+    policy = mlog::FlushPolicy{};
+    policy.every_records = 3;
+    policy.on_endl = false;
+    mlog::get_logger("flush").set_flush_policy(policy);
+    mlog::info("flush") << " first\n";
+    mlog::info("flush") << " second" << std::endl;
+    const bool counted = !on_disk("second");
+    mlog::info("flush") << " third\n";
+
+    // 距离上次冲刷超过200毫秒时，随下一条记录冲刷
+    policy = mlog::FlushPolicy{};
+    policy.interval = std::chrono::milliseconds(200);
+    policy.on_endl = false;
+    mlog::get_logger("flush").set_flush_policy(policy);
+    mlog::info("flush") << " quiet\n";
+    const bool timed = !on_disk("quiet");
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    mlog::info("flush") << " late\n";
+
+    return buffered && flushed && counted && on_disk("third") && timed
+           && on_disk("quiet") && on_disk("late");
+}
+
+// 格式模板：时间、等级、名称、进程和线程id、调用点都在记录开头
+bool test8() {
+    const std::string file_name = "pattern.log";
+    mlog::create_logger("pattern")
+        .set_pattern("%Y-%m-%d %T.%f [%L|%l] {%n} %P/%t %s %#: %%")
+        .link_file_trunc(file_name);
+
+    MLOG_WARN("pattern") << "from macro\n";
+    mlog::info("pattern") << "no site\n";
+    mlog::get_logger("pattern").link_none();
+
+    std::ifstream fin(MLogFileManager::get_path_prefix() + file_name);
+    const std::string content{std::istreambuf_iterator<char>(fin),
+                              std::istreambuf_iterator<char>()};
+
+    const std::regex macro_line{
+        R"(\d{4}-\d{2}-\d{2} \d{2}:\d{2}:\d{2}\.\d{6} \[W\|WARN\] \{pattern\} )"
+        R"(\d+/\d+ mlog_demo\.cpp:\d+ \d+: %from macro\n)"};
+    const std::regex plain_line{R"(\[I\|INFO\] \{pattern\} \d+/\d+  : %no site\n)"};
+    return std::regex_search(content, macro_line)
+           && std::regex_search(content, plain_line);
+}
+
+// 旁路索引：按时间范围和等级只读取相关的段
+bool test9() {
+    const std::string file_name = "indexed.log";
+    const std::string path = MLogFileManager::get_path_prefix() + file_name;
+    mlog::create_logger("indexed")
+        .set_file_index(1024)
+        .link_file_trunc(file_name);
+
+    const auto write_lines = [](const std::string &tag, int count) {
+        for (int i = 0; i < count; ++i) {
+            mlog::info("indexed") << " " << tag << " line " << i << '\n';
+        }
+    };
+
+    write_lines("before", 2000);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    const auto from = std::chrono::system_clock::now();
+    write_lines("during", 100);
+    mlog::error("indexed") << " incident\n";
+    const auto to = std::chrono::system_clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    write_lines("after", 2000);
+    mlog::get_logger("indexed").link_none();  // 关闭时写出最后一段
+
+    std::vector<MLogIndex::Entry> entries;
+    if (!MLogIndex::load(path, entries) || entries.empty()) return false;
+
+    // 索引覆盖整个文件，各段首尾相接
+    bool ok = entries.front().offset == 0
+              && entries.back().offset + entries.back().size
+                     == std::filesystem::file_size(path);
+    for (std::size_t i = 1; i < entries.size(); ++i) {
+        ok = ok && entries[i].offset == entries[i - 1].offset + entries[i - 1].size;
+    }
+
+    std::ostringstream in_range;
+    MLogIndex::copy(path, MLogIndex::select(entries, from, to), in_range);
+    std::ostringstream errors;
+    MLogIndex::copy(path, MLogIndex::select(entries, mlog::Level::error), errors);
+
+    const auto size = std::filesystem::file_size(path);
+    return ok && in_range.str().find("during line 0\n") != std::string::npos
+           && in_range.str().find("during line 99\n") != std::string::npos
+           && in_range.str().find("incident") != std::string::npos
+           && in_range.str().size() * 10 < size
+           && errors.str().find("incident") != std::string::npos
+           && errors.str().size() * 10 < size;
+}
+
+// 调用点的默认文本形式只有函数名，例如[mlog_demo.cpp test10 12]
+bool test10() {
+    const std::string file_name = "stamp.log";
+    mlog::create_logger("stamp").link_file_trunc(file_name);
+
+    MLOG_INFO("stamp") << "from macro\n";
+    mlog::info("stamp") << MLOG_STAMP;
+    mlog::get_logger("stamp").link_none();
+
+    std::ifstream fin(MLogFileManager::get_path_prefix() + file_name);
+    const std::string content{std::istreambuf_iterator<char>(fin),
+                              std::istreambuf_iterator<char>()};
+
+    const std::regex stamp_line{R"(mlog_demo\.cpp test10 \d+\]\n)"};
+    return std::distance(std::sregex_iterator(content.begin(), content.end(),
+                                              stamp_line),
+                         std::sregex_iterator())
+           == 2;
+}
+
 }  // namespace
 
 int main(int argc, char *argv[]) {
@@ -54,8 +260,13 @@ int main(int argc, char *argv[]) {
     test("A");
     test("B");
     test("C");
+    test("micro");
 
     test2();
+    test3();
 
-    return 0;
+    const bool ok =
+        test4() && test5() && test6() && test7() && test8() && test9()
+        && test10();
+    return ok ? 0 : 1;
 }
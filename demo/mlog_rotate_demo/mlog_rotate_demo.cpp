@@ -0,0 +1,104 @@
+#include "allay/mlog/mlog.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr std::uintmax_t max_size = 4096;
+constexpr std::size_t max_files = 3;
+constexpr int line_num = 2000;
+
+bool check(bool cond, const std::string &msg) {
+    if (!cond) { std::cerr << "mlog_rotate_demo: check failed: " << msg << '\n'; }
+    return cond;
+}
+
+// 目录中属于file_name的所有文件：file_name本身和它的旧文件
+std::vector<fs::path> rotated_files(const std::string &file_name) {
+    std::vector<fs::path> files;
+    for (const auto &entry :
+         fs::directory_iterator(MLogFileManager::get_path_prefix())) {
+        if (entry.path().filename().string().rfind(file_name, 0) == 0) {
+            files.push_back(entry.path());
+        }
+    }
+    std::ranges::sort(files);
+    return files;
+}
+
+void remove_files(const std::string &file_name) {
+    for (const auto &file : rotated_files(file_name)) fs::remove(file);
+}
+
+// 只保留max_files个旧文件，每个文件不超过上限太多，并且以MLOG START开头
+bool check_files(const std::string &file_name) {
+    const auto files = rotated_files(file_name);
+
+    bool ok = check(files.size() == max_files + 1,
+                    "number of files of " + file_name);
+    for (const auto &file : files) {
+        std::ifstream fin(file);
+        std::string first;
+        std::getline(fin, first);
+
+        ok = check(fs::file_size(file) < max_size + 256,
+                   "size of " + file.string())
+             && check(first.find("MLOG START") != std::string::npos,
+                      "first line of " + file.string())
+             && ok;
+    }
+
+    // 最后一个文件的最后一条记录是最新写入的
+    const auto last_index = std::to_string(line_num - 1);
+    std::ifstream fin(MLogFileManager::get_path_prefix() + file_name);
+    std::string line;
+    std::string last;
+    while (std::getline(fin, line)) {
+        if (line.find(" line ") != std::string::npos) last = line;
+    }
+    return check(last.ends_with(" line " + last_index),
+                 "last record of " + file_name + ": " + last)
+           && ok;
+}
+
+bool test_size(const std::string &name) {
+    const std::string file_name = name + ".log";
+    remove_files(file_name);
+
+    mlog::RotatePolicy policy;
+    policy.max_size = max_size;
+    policy.max_files = max_files;
+    mlog::create_logger(name)
+        .set_format(mlog::Format::LEVEL_SIGNATURE_TIME)
+        .link_file_rotating(file_name, policy);
+
+    for (int i = 0; i < line_num; ++i) {
+        mlog::info(name) << " line " << i << '\n';
+    }
+
+    // 重新指向cout，等待后台线程完成所有的重命名
+    mlog::get_logger(name).link_cout();
+
+    return check_files(file_name);
+}
+
+}  // namespace
+
+int main() {
+    mlog::init(PREFIX + std::string("/.mlog/"));
+    mlog::set_level_info();
+
+    bool ok = test_size("sync");
+
+    mlog::init_async(1024, mlog::OverflowPolicy::BLOCK);
+    ok = test_size("async") && ok;
+    mlog::shutdown_async();
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,550 @@
+#include "allay/mlog/mlog.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(MLOG_HAS_SIGACTION) || defined(MLOG_HAS_O_APPEND)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+bool check(bool cond, const std::string &msg) {
+    if (!cond) { std::cerr << "mlog_sink_demo: check failed: " << msg << '\n'; }
+    return cond;
+}
+
+std::size_t count(const std::string &text, const std::string &pattern) {
+    std::size_t result = 0;
+    for (auto pos = text.find(pattern); pos != std::string::npos;
+         pos = text.find(pattern, pos + pattern.size())) {
+        ++result;
+    }
+    return result;
+}
+
+std::string read_file(const std::string &file_name) {
+    std::ifstream fin(MLogFileManager::get_path_prefix() + file_name);
+    std::stringstream ss;
+    ss << fin.rdbuf();
+    return ss.str();
+}
+
+// 一个logger同时写入内存流、文件sink和自己的日志文件，每个输出各收到一份
+bool test_sinks(const std::string &name) {
+    const std::string file_name = name + ".log";
+    const std::string sink_name = name + ".sink.log";
+
+    std::ostringstream memory;
+    auto warn_sink = std::make_shared<MLogStreamSink>(memory);
+    warn_sink->set_level(mlog::Level::warn);
+
+    std::ostringstream all;
+    auto file_sink = std::make_shared<MLogFileSink>(sink_name, true);
+
+    mlog::create_logger(name)
+        .set_format(mlog::Format::LEVEL)
+        .link_file_trunc(file_name)
+        .add_sink(std::make_shared<MLogStreamSink>(all))
+        .add_sink(warn_sink)
+        .add_sink(file_sink);
+
+    mlog::info(name) << "first " << 1 << '\n';
+    mlog::warn(name) << "second " << 2 << '\n';
+    mlog::error(name) << "third " << 3 << std::endl;
+
+    mlog::get_logger(name).flush();
+
+    bool ok = check(file_sink->is_open(), "open " + sink_name);
+
+    const std::string log_text = read_file(file_name);
+    const std::string sink_text = read_file(sink_name);
+    for (const std::string line : {"first 1", "second 2", "third 3"}) {
+        ok = check(count(log_text, line) == 1, line + " in " + file_name)
+             && check(count(sink_text, line) == 1, line + " in " + sink_name)
+             && check(count(all.str(), line) == 1, line + " in stream sink")
+             && ok;
+    }
+
+    // logger自己的提示行不写入sink，sink的等级过滤只影响这个sink
+    ok = check(count(sink_text, "MLOG START") == 0, "notice in sink")
+         && check(count(memory.str(), "first 1") == 0, "sink level filter")
+         && check(count(memory.str(), "second 2") == 1, "sink level warn")
+         && check(count(memory.str(), "third 3") == 1, "sink level error")
+         && ok;
+
+    // 先关闭logger再释放内存流
+    mlog::get_logger(name).clear_sinks().link_cout();
+    return ok;
+}
+
+// 结构化记录：文件中是JSON Lines，文本sink中是key=value
+bool test_json(const std::string &name) {
+    const std::string file_name = name + ".jsonl";
+
+    std::ostringstream text;
+    std::ostringstream json;
+    auto json_sink = std::make_shared<MLogStreamSink>(json);
+    json_sink->set_encoding(mlog::Encoding::JSON);
+
+    mlog::create_logger(name)
+        .set_format(mlog::Format::LEVEL)
+        .set_encoding(mlog::Encoding::JSON)
+        .link_file_trunc(file_name)
+        .add_sink(std::make_shared<MLogStreamSink>(text))
+        .add_sink(json_sink);
+
+    mlog::info(name)
+        .kv("user", 42)
+        .kv("lat_us", 17.5)
+        .kv("ok", true)
+        .msg("say \"hi\"\n\tend");
+    mlog::warn(name) << " plain " << 3 << '\n';
+    mlog::get_logger(name).flush();
+
+    const std::string expect_fields =
+        R"(,"user":42,"lat_us":17.5,"ok":true,"msg":"say \"hi\"\n\tend"}
+)";
+    const std::string expect_plain = R"("level":"WARN","logger":")" + name
+                                     + R"(","msg":"plain 3"}
+)";
+
+    std::istringstream file_lines(read_file(file_name));
+    bool ok = true;
+    for (std::string line; std::getline(file_lines, line);) {
+        ok = check(line.starts_with(R"({"time":")") && line.ends_with("}"),
+                   "json line: " + line)
+             && ok;
+    }
+
+    ok = check(count(read_file(file_name), expect_fields) == 1,
+               "json fields in " + file_name)
+         && check(count(read_file(file_name), expect_plain) == 1,
+                  "json plain record in " + file_name)
+         && check(count(json.str(), expect_fields) == 1, "json sink")
+         && check(count(text.str(), "[INFO] user=42 lat_us=17.5 ok=true say")
+                      == 1,
+                  "text sink: " + text.str())
+         && check(count(text.str(), "[WARN] plain 3\n") == 1, "text plain")
+         && ok;
+
+    mlog::get_logger(name).clear_sinks().link_cout();
+    return ok;
+}
+
+// 飞行记录器保留最近的debug记录，其它输出只看到info及以上
+bool test_recorder(const std::string &name) {
+    const std::string file_name = name + ".recent.log";
+
+    std::ostringstream console;
+    auto info_sink = std::make_shared<MLogStreamSink>(console);
+    info_sink->set_level(mlog::Level::info);
+
+    mlog::create_logger(name)
+        .set_format(mlog::Format::LEVEL)
+        .link_none()
+        .set_level(mlog::Level::debug);
+    mlog::get_logger(name).add_sink(info_sink);
+    auto ring = mlog::enable_flight_recorder(mlog::get_logger(name), file_name,
+                                             4096, 4);
+
+    for (int i = 0; i < 10; ++i) mlog::debug(name) << "step " << i << '\n';
+    mlog::info(name) << "done\n";
+
+    bool ok = check(ring != nullptr, "enable_flight_recorder")
+              && check(mlog::dump_recent() >= 1, "dump_recent");
+    if (!ok) return false;
+
+    const std::string recent = ring->recent();
+    ok = check(count(recent, "step ") == 3, "records kept: " + recent)
+         && check(count(recent, "step 9") == 1, "newest debug record")
+         && check(count(recent, "done") == 1, "newest info record")
+         && check(read_file(file_name) == recent, "dumped " + file_name)
+         && check(count(console.str(), "step ") == 0, "debug in other sink")
+         && check(count(console.str(), "done") == 1, "info in other sink");
+
+    mlog::get_logger(name).clear_sinks().link_cout();
+    return ok;
+}
+
+// 只按字节截断时从完整的一行开始
+bool test_ring_bytes() {
+    MLogRingSink ring(64);
+    for (int i = 0; i < 100; ++i) {
+        const std::string line = "record " + std::to_string(i) + '\n';
+        ring.write(MLogRecordView{line, mlog::Level::info});
+    }
+
+    const std::string recent = ring.recent();
+    return check(recent.size() <= 64, "ring size")
+           && check(recent.starts_with("record "), "ring start: " + recent)
+           && check(recent.ends_with("record 99\n"), "ring end: " + recent);
+}
+
+// 记录析构时所在的线程
+class TrackedSink : public MLogRingSink {
+public:
+    explicit TrackedSink(std::thread::id *destroyed_on)
+        : MLogRingSink(4096), m_destroyed_on(destroyed_on) {}
+
+    ~TrackedSink() override { *m_destroyed_on = std::this_thread::get_id(); }
+
+private:
+    std::thread::id *m_destroyed_on;
+};
+
+// 其它线程写日志的同时增加和移除sink，同时还有线程不断地打开和关闭其它文件sink
+// 被移除的sink在调用clear_sinks的线程中析构
+bool test_live_sinks() {
+    constexpr int thread_num = 4;
+    constexpr std::size_t sink_num = 8;
+
+    mlog::create_logger("live").link_none();
+
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_num; ++t) {
+        threads.emplace_back([t, &stop]() {
+            for (int i = 0; !stop; ++i) {
+                mlog::info("live") << " thread " << t << " line " << i << '\n';
+            }
+        });
+    }
+    threads.emplace_back([&stop]() {
+        for (int i = 0; !stop; ++i) {
+            MLogFileSink churn("churn_" + std::to_string(i % 4) + ".log", true);
+        }
+    });
+
+    // 每个sink都应当在加入之后收到记录
+    std::vector<std::shared_ptr<MLogRingSink>> rings;
+    std::vector<std::thread::id> destroyed_on(sink_num);
+    bool all_received = true;
+    for (std::size_t i = 0; i < sink_num; ++i) {
+        const std::string file_name = "live_" + std::to_string(i) + ".log";
+        std::remove((MLogFileManager::get_path_prefix() + file_name).c_str());
+
+        auto &logger = mlog::get_logger("live");
+        logger.add_sink(std::make_shared<MLogFileSink>(file_name, true));
+        logger.add_sink(std::make_shared<TrackedSink>(&destroyed_on[i]));
+        rings.push_back(std::make_shared<MLogRingSink>(4096));
+        logger.add_sink(rings.back());
+        for (int k = 0; k < 500 && rings.back()->recent().empty(); ++k) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        all_received = all_received && !rings.back()->recent().empty();
+        if (i % 2 == 1) logger.clear_sinks();
+    }
+
+    stop = true;
+    for (auto &th : threads) th.join();
+    mlog::get_logger("live").clear_sinks();
+
+    bool files_written = true;
+    bool retired_here = true;
+    for (std::size_t i = 0; i < sink_num; ++i) {
+        files_written =
+            files_written
+            && read_file("live_" + std::to_string(i) + ".log")
+                       .find("[INFO]{live} thread ")
+                   != std::string::npos;
+        retired_here =
+            retired_here && destroyed_on[i] == std::this_thread::get_id();
+    }
+
+    const std::string recent = rings.back()->recent();
+    return check(all_received, "every live sink received records")
+           && check(recent.find("[INFO]{live} thread ") != std::string::npos,
+                    "live sink content: " + recent.substr(0, 80))
+           && check(files_written, "every live file sink wrote records")
+           && check(retired_here, "removed sinks are destroyed by clear_sinks");
+}
+
+// 压缩和解压的边界情况：空、很短、很长的重复、无法压缩
+bool test_lz() {
+    std::string noise(5000, '\0');
+    std::uint32_t state = 12345;
+    for (char &ch : noise) {
+        state = state * 1103515245U + 12345U;
+        ch = static_cast<char>(state >> 24U);
+    }
+
+    bool ok = true;
+    MLogLz::HashTable table{};
+    for (const std::string &raw :
+         {std::string{}, std::string{"abc"}, std::string(100000, 'x'),
+          std::string{"abcabcabcabcabcabcabcabcabcabcab"}, noise}) {
+        std::string block;
+        MLogLz::encode_block(block, raw, table);
+        std::istringstream in(block);
+        std::ostringstream out;
+        ok = check(MLogLz::decode(in, out) && out.str() == raw,
+                   "lz round trip of " + std::to_string(raw.size()) + " bytes")
+             && ok;
+    }
+    return ok;
+}
+
+// 文件中每一块的原文长度，从块头中读取
+std::vector<std::size_t> block_raw_sizes(const std::string &stored) {
+    std::vector<std::size_t> result;
+    for (std::size_t pos = 0; pos + MLogLz::header_size <= stored.size();) {
+        std::uint32_t raw_size = 0;
+        std::uint32_t stored_size = 0;
+        std::memcpy(&raw_size, stored.data() + pos + 4, 4);
+        std::memcpy(&stored_size, stored.data() + pos + 8, 4);
+        result.push_back(raw_size);
+        pos += MLogLz::header_size + stored_size;
+    }
+    return result;
+}
+
+std::size_t max_block_raw(const std::string &stored) {
+    const auto sizes = block_raw_sizes(stored);
+    return sizes.empty() ? 0 : *std::ranges::max_element(sizes);
+}
+
+// 分块压缩的文件解压之后与文本完全相同，损坏的块只影响它自己
+bool test_compressed(const std::string &name) {
+    const std::string file_name = name + ".mlz";
+
+    std::ostringstream all;
+    auto sink = std::make_shared<MLogCompressedSink>(file_name, 4096, true);
+
+    mlog::create_logger(name)
+        .set_format(mlog::Format::LEVEL_SIGNATURE_TIME)
+        .link_none()
+        .add_sink(std::make_shared<MLogStreamSink>(all))
+        .add_sink(sink);
+
+    for (int i = 0; i < 5000; ++i) {
+        mlog::info(name) << " request " << i << " from user " << i % 17
+                         << " took " << i % 100 << " ms" << std::endl;
+        // 比块更长的记录被切分到多个块中
+        if (i == 2500) mlog::info(name) << std::string(10000, 'x') << '\n';
+    }
+    mlog::get_logger(name).flush();
+
+    const std::string stored = read_file(file_name);
+    std::istringstream in(stored);
+    std::ostringstream out;
+    bool ok = check(sink->is_open(), "open " + file_name)
+              && check(MLogLz::decode(in, out), "decode " + file_name)
+              && check(out.str() == all.str(), "decoded text of " + file_name)
+              && check(sink->stored_bytes() * 3 < sink->raw_bytes(),
+                       "compression ratio of " + file_name);
+
+    // 跳过前两块
+    std::istringstream skip_in(stored);
+    std::ostringstream skip_out;
+    const auto sizes = block_raw_sizes(stored);
+    ok = check(MLogLz::decode(skip_in, skip_out, 2) && sizes.size() > 2
+                   && all.str().ends_with(skip_out.str())
+                   && skip_out.str().size() + sizes[0] + sizes[1]
+                          == all.str().size(),
+               "skip blocks of " + file_name)
+         && ok;
+
+    // 破坏中间某一块的内容和另一块的块头
+    std::string broken = stored;
+    broken[stored.size() / 2] = static_cast<char>(~broken[stored.size() / 2]);
+    broken[MLogLz::header_size + 1] = 'X';
+    std::istringstream broken_in(broken);
+    std::ostringstream broken_out;
+    ok = check(!MLogLz::decode(broken_in, broken_out), "detect corruption")
+         && check(broken_out.str().size() < all.str().size()
+                      && broken_out.str().size() + 3 * 4096 > all.str().size(),
+                  "recover after corruption")
+         && ok;
+
+    mlog::get_logger(name).clear_sinks();
+    return ok
+           && check(max_block_raw(stored) <= 4096, "block size of " + file_name);
+}
+
+// 块的大小取上限时，超过上限的记录和之后放不下的记录都不会产生过大的块
+bool test_compressed_oversize() {
+    const std::string file_name = "oversize.mlz";
+    const std::string big(MLogLz::max_block_size + 100, 'y');
+    {
+        MLogCompressedSink sink(file_name, MLogLz::max_block_size, true);
+        sink.write(MLogRecordView{.text = "first\n"});
+        sink.write(MLogRecordView{.text = big});
+        sink.write(MLogRecordView{.text = "last\n"});
+    }
+
+    const std::string stored = read_file(file_name);
+    std::istringstream in(stored);
+    std::ostringstream out;
+    return check(MLogLz::decode(in, out), "decode " + file_name)
+           && check(out.str() == "first\n" + big + "last\n",
+                    "decoded text of " + file_name)
+           && check(max_block_raw(stored) <= MLogLz::max_block_size,
+                    "block size of " + file_name);
+}
+
+#ifdef MLOG_HAS_SIGACTION
+// 子进程调用std::terminate，父进程检查崩溃时写出的文件
+bool test_crash() {
+    const std::string file_name = "crash.recent.log";
+    std::remove((MLogFileManager::get_path_prefix() + file_name).c_str());
+
+    const ::pid_t pid = ::fork();
+    if (pid == 0) {
+        mlog::create_logger("crash").link_none();
+        mlog::enable_flight_recorder(mlog::get_logger("crash"), file_name, 1024);
+        mlog::set_level("crash", mlog::Level::debug);
+        mlog::debug("crash") << "before crash\n";
+        std::terminate();
+    }
+
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    return check(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT,
+                 "child aborted")
+           && check(count(read_file(file_name), "before crash") == 1,
+                    "crash dump");
+}
+#endif
+
+#ifdef MLOG_HAS_O_APPEND
+// 多个进程同时追加到同一个文件，每一行都应当是某个进程完整的一条记录
+bool test_shared() {
+    constexpr int proc_num = 8;
+    constexpr int record_num = 500;
+    const std::string file_name = "shared.log";
+    std::remove((MLogFileManager::get_path_prefix() + file_name).c_str());
+
+    std::vector<::pid_t> children;
+    for (int p = 0; p < proc_num; ++p) {
+        const ::pid_t pid = ::fork();
+        if (pid != 0) {
+            children.push_back(pid);
+            continue;
+        }
+
+        auto sink = std::make_shared<MLogAppendSink>(file_name);
+        mlog::create_logger("shared")
+            .set_format(mlog::Format::LEVEL_SIGNATURE)
+            .link_none()
+            .add_sink(sink);
+        for (int i = 0; i < record_num; ++i) {
+            // 长度不同的记录，最长接近max_atomic_size
+            const auto len = static_cast<std::size_t>((i * 37 + p * 101) % 3500);
+            mlog::info("shared") << " proc " << p << " len " << len << ' '
+                                 << std::string(len, static_cast<char>('a' + p))
+                                 << " end\n";
+        }
+        std::_Exit(sink->is_open() ? 0 : 1);
+    }
+
+    bool ok = true;
+    for (const ::pid_t pid : children) {
+        int status = 0;
+        ::waitpid(pid, &status, 0);
+        ok = check(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+                   "shared child exited")
+             && ok;
+    }
+
+    std::ifstream fin(MLogFileManager::get_path_prefix() + file_name);
+    std::string line;
+    int lines = 0;
+    int broken = 0;
+    while (std::getline(fin, line)) {
+        ++lines;
+        std::istringstream iss(line);
+        std::string head;
+        std::string proc;
+        std::string tag;
+        int p = -1;
+        std::size_t len = 0;
+        iss >> head >> proc >> p >> tag >> len;
+        const std::string tail =
+            std::string(len, static_cast<char>('a' + p)) + " end";
+        if (head != "[INFO]{shared}" || p < 0 || p >= proc_num
+            || !line.ends_with(" " + tail)) {
+            ++broken;
+        }
+    }
+
+    return ok && check(lines == proc_num * record_num, "shared lines")
+           && check(broken == 0, std::to_string(broken) + " broken records");
+}
+
+// 格式模板中的进程id和线程id在fork之后属于子进程，而不是父进程缓存的值
+bool test_fork_pattern() {
+    const std::string file_name = "forked.log";
+    std::remove((MLogFileManager::get_path_prefix() + file_name).c_str());
+
+    auto sink = std::make_shared<MLogAppendSink>(file_name);
+    mlog::create_logger("forked").set_pattern("%P %t ").link_none().add_sink(sink);
+    mlog::info("forked") << "parent\n";
+
+    const ::pid_t pid = ::fork();
+    if (pid == 0) {
+        mlog::info("forked") << "child\n";
+        std::_Exit(0);
+    }
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    mlog::get_logger("forked").clear_sinks();
+
+    const std::string child = std::to_string(pid);
+    const std::string parent = std::to_string(::getpid());
+    const std::string content = read_file(file_name);
+#if defined(__linux__)
+    // 主线程的线程id等于进程id
+    const std::string expected = parent + ' ' + parent + " parent\n" + child
+                                 + ' ' + child + " child\n";
+    return check(content == expected, "ids after fork: " + content);
+#else
+    return check(content.starts_with(parent + ' ')
+                     && content.find('\n' + child + ' ') != std::string::npos,
+                 "ids after fork: " + content);
+#endif
+}
+#endif
+
+}  // namespace
+
+int main() {
+    mlog::init(PREFIX + std::string("/.mlog/"));
+    mlog::set_level_info();
+
+    bool ok = test_sinks("sync");
+
+    ok = test_recorder("recorder") && ok;
+    ok = test_json("json") && ok;
+    ok = test_ring_bytes() && ok;
+    ok = test_live_sinks() && ok;
+    ok = test_lz() && ok;
+    ok = test_compressed("compressed") && ok;
+    ok = test_compressed_oversize() && ok;
+#ifdef MLOG_HAS_SIGACTION
+    ok = test_crash() && ok;
+#endif
+#ifdef MLOG_HAS_O_APPEND
+    ok = test_shared() && ok;
+    ok = test_fork_pattern() && ok;
+#endif
+
+    mlog::init_async(1024, mlog::OverflowPolicy::BLOCK);
+    ok = test_sinks("async") && ok;
+    ok = test_recorder("async_recorder") && ok;
+    ok = test_json("async_json") && ok;
+    ok = test_compressed("async_compressed") && ok;
+    mlog::shutdown_async();
+
+    return ok ? 0 : 1;
+}
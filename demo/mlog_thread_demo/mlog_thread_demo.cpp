@@ -0,0 +1,407 @@
+#include "allay/mlog/mlog.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr int thread_num = 4;
+constexpr int line_num = 2000;
+
+std::size_t count_lines(const std::string &file_name) {
+    std::ifstream fin(MLogFileManager::get_path_prefix() + file_name);
+    return static_cast<std::size_t>(
+        std::count(std::istreambuf_iterator<char>(fin),
+                   std::istreambuf_iterator<char>(), '\n'));
+}
+
+// 每一行都应当是完整的记录，不会和其它线程的记录交错
+bool lines_intact(const std::string &file_name, const std::string &name) {
+    const std::string head = "[INFO]{" + name + "}[";
+
+    std::ifstream fin(MLogFileManager::get_path_prefix() + file_name);
+    std::string line;
+    while (std::getline(fin, line)) {
+        if (line.rfind("[-----]", 0) == 0) continue;
+        if (line.rfind(head, 0) != 0
+            || line.find(" thread ") == std::string::npos
+            || line.find(" thread ") != line.rfind(" thread ")) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool check(bool cond, const std::string &msg) {
+    if (!cond) { std::cerr << "mlog_thread_demo: check failed: " << msg << '\n'; }
+    return cond;
+}
+
+// 多个线程同时向同一个logger写日志
+void produce(const std::string &name) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_num; ++t) {
+        threads.emplace_back([t, &name]() {
+            for (int i = 0; i < line_num; ++i) {
+                mlog::info(name) << " thread " << t << " line " << i << '\n';
+            }
+        });
+    }
+    for (auto &th : threads) th.join();
+}
+
+// notice_lines是额外的 MLOG START 和 MLOG END 的行数
+bool check_file(const std::string &name, std::size_t notice_lines = 1) {
+    const std::string file_name = name + ".log";
+
+    return check(count_lines(file_name)
+                     == static_cast<std::size_t>(thread_num * line_num)
+                            + notice_lines,
+                 "lines of " + file_name)
+           && check(lines_intact(file_name, name),
+                    "records are not interleaved in " + file_name);
+}
+
+bool test_sync() {
+    mlog::create_logger("sync")
+        .set_format(mlog::Format::LEVEL_SIGNATURE_TIME)
+        .link_file_trunc("sync.log")
+        .lock();
+
+    produce("sync");
+    mlog::get_logger("sync").flush();
+
+    return check_file("sync");
+}
+
+// BLOCK策略下不丢弃记录，容量很小时生产者频繁地等待后台线程腾出空间
+bool test_block(const std::string &name, std::size_t capacity) {
+    mlog::create_logger(name)
+        .set_format(mlog::Format::LEVEL_SIGNATURE_TIME)
+        .link_file_trunc(name + ".log")
+        .lock();
+
+    mlog::init_async(capacity, mlog::OverflowPolicy::BLOCK);
+
+    produce(name);
+
+    mlog::get_logger(name).flush();
+    auto stats = mlog::async_stats();
+    mlog::shutdown_async();
+
+    return check_file(name)
+           && check(stats.dropped_newest == 0 && stats.dropped_oldest == 0,
+                    "no record is dropped under BLOCK");
+}
+
+// mmap文件，段很小，让记录频繁地跨越段边界
+bool test_mmap() {
+    mlog::create_logger("mmap")
+        .set_format(mlog::Format::LEVEL_SIGNATURE_TIME)
+        .link_file_mmap("mmap.log", 4096)
+        .lock();
+
+    produce("mmap");
+
+    // 重新打开时关闭mmap文件，截断到实际长度
+    mlog::get_logger("mmap").unlock().link_none();
+
+    return check_file("mmap", 2);
+}
+
+#ifdef MLOG_HAS_MMAP
+// 模拟崩溃：写入之后不关闭就复制文件，副本末尾是预分配的0字节，恢复后只剩实际内容
+bool test_mmap_recover() {
+    const std::string path = MLogFileManager::get_path_prefix() + "crashed.log";
+    const std::string copy = path + ".copy";
+
+    MLogMmapFile file;
+    if (!file.open(path, 4096)) return check(false, "open " + path);
+    file.append("first line\n");
+    file.append("second line\n");
+    file.flush();
+    std::filesystem::copy_file(path, copy,
+                               std::filesystem::copy_options::overwrite_existing);
+    file.close();
+
+    const auto size_before = std::filesystem::file_size(copy);
+    const bool recovered = MLogMmapFile::recover(copy);
+    std::ifstream fin(copy, std::ios_base::binary);
+    const std::string content{std::istreambuf_iterator<char>(fin),
+                              std::istreambuf_iterator<char>()};
+    return check(size_before == 4096, "preallocated size of the crashed copy")
+           && check(recovered && content == "first line\nsecond line\n",
+                    "recovered content: " + content);
+}
+#endif
+
+// 容量很小的队列，检查丢弃计数
+bool test_drop(mlog::OverflowPolicy policy) {
+    const auto before = mlog::async_stats();
+
+    mlog::init_async(4, policy);
+    for (int i = 0; i < line_num; ++i) { mlog::out("drop") << "drop\n"; }
+    mlog::shutdown_async();
+
+    const auto after = mlog::async_stats();
+    const auto enqueued = after.enqueued - before.enqueued;
+    const auto written = after.written - before.written;
+    const auto dropped_newest = after.dropped_newest - before.dropped_newest;
+    const auto dropped_oldest = after.dropped_oldest - before.dropped_oldest;
+
+    mlog::out() << "enqueued = " << enqueued << ", written = " << written
+                << ", dropped_newest = " << dropped_newest
+                << ", dropped_oldest = " << dropped_oldest << '\n';
+
+    if (policy == mlog::OverflowPolicy::DROP_NEWEST) {
+        return check(enqueued + dropped_newest == line_num,
+                     "enqueued + dropped_newest")
+               && check(written == enqueued, "written under DROP_NEWEST");
+    }
+    return check(enqueued == line_num, "enqueued under DROP_OLDEST")
+           && check(written + dropped_oldest == enqueued,
+                    "written + dropped_oldest");
+}
+
+// 多个线程同时经过同一个调用点，通过的次数是准确的
+bool test_judge() {
+    std::atomic<int> first{0};
+    std::atomic<int> every{0};
+    std::atomic<std::size_t> every_suppressed{0};
+    std::atomic<int> more{0};
+    std::atomic<int> rate{0};
+    std::atomic<int> sample{0};
+    std::atomic<int> every_ms{0};
+    std::atomic<int> every_zero{0};
+    std::atomic<int> rate_zero{0};
+    std::atomic<int> burst_zero{0};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_num; ++t) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < line_num; ++i) {
+                MLOG_IF_FIRST_N(100) { ++first; }
+                MLOG_IF_EVERY_N(10) {
+                    ++every;
+                    every_suppressed += mlog_pass.suppressed;
+                }
+                MLOG_IF_MORETHAN_N(100) { ++more; }
+                MLOG_RATE_LIMIT(1, 5) { ++rate; }
+                MLOG_SAMPLE(0.25) { ++sample; }
+                MLOG_EVERY_MS(60000) { ++every_ms; }
+                // 参数越界时不会除以0，也不会溢出
+                MLOG_IF_EVERY_N(0) { ++every_zero; }
+                MLOG_RATE_LIMIT(0, 3) { ++rate_zero; }
+                MLOG_RATE_LIMIT(1, 0) { ++burst_zero; }
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+
+    constexpr int total = thread_num * line_num;
+    return check(first == 100, "MLOG_IF_FIRST_N")
+           && check(every == total / 10, "MLOG_IF_EVERY_N")
+           && check(every_suppressed == static_cast<std::size_t>(total / 10 - 1) * 9,
+                    "MLOG_IF_EVERY_N suppressed")
+           && check(more == total - 100, "MLOG_IF_MORETHAN_N")
+           && check(rate >= 5 && rate <= 10, "MLOG_RATE_LIMIT")
+           && check(sample > total / 8 && sample < total / 2, "MLOG_SAMPLE")
+           && check(every_ms == 1, "MLOG_EVERY_MS")
+           && check(every_zero == total, "MLOG_IF_EVERY_N(0)")
+           && check(rate_zero == 3, "MLOG_RATE_LIMIT(0, 3)")
+           && check(burst_zero >= 1 && burst_zero <= 2, "MLOG_RATE_LIMIT(1, 0)");
+}
+
+// 一个线程不断创建新的logger，其它线程同时按名称查找logger并写日志
+bool test_registry() {
+    constexpr int plugin_num = 200;
+
+    mlog::create_logger("registry")
+        .set_format(mlog::Format::LEVEL_SIGNATURE_TIME)
+        .link_file_trunc("registry.log")
+        .lock();
+
+    std::atomic<bool> created{false};
+    std::thread creator([&created]() {
+        for (int i = 0; i < plugin_num; ++i) {
+            mlog::create_logger("plugin" + std::to_string(i)).link_none();
+        }
+        created = true;
+    });
+
+    std::atomic<int> found{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_num; ++t) {
+        threads.emplace_back([t, &found]() {
+            for (int i = 0; i < line_num; ++i) {
+                mlog::info("registry") << " thread " << t << " line " << i << '\n';
+                const std::string name = "plugin" + std::to_string(i % plugin_num);
+                if (MLoggerManager::find_logger(name) != nullptr) ++found;
+            }
+        });
+    }
+    for (auto &th : threads) th.join();
+    creator.join();
+    mlog::get_logger("registry").flush();
+
+    bool all_found = created.load();
+    for (int i = 0; i < plugin_num; ++i) {
+        all_found = all_found
+                    && &mlog::get_logger("plugin" + std::to_string(i))
+                           == MLoggerManager::find_logger("plugin"
+                                                          + std::to_string(i));
+    }
+
+    mlog::out() << "registry lookups found = " << found.load() << '\n';
+    return check_file("registry") && check(all_found, "all plugins registered");
+}
+
+// 其它线程写日志的同时切换格式模板和时间精度，每条记录都完整地使用其中一种格式
+bool test_pattern() {
+    mlog::create_logger("pattern")
+        .set_format(mlog::Format::LEVEL_SIGNATURE_TIME)
+        .link_file_trunc("pattern.log");
+
+    std::atomic<bool> stop{false};
+    std::thread switcher([&stop]() {
+        auto &logger = mlog::get_logger("pattern");
+        for (int i = 0; !stop.load(); ++i) {
+            switch (i % 4) {
+            case 0: logger.set_pattern("[%l]{%n}[%H:%M:%S] "); break;
+            case 1: logger.set_pattern("[%l]{%n}[%e] "); break;
+            case 2: logger.set_format(mlog::Format::LEVEL_SIGNATURE_TIME); break;
+            default:
+                logger.set_time_precision(i % 8 == 3
+                                              ? mlog::TimePrecision::NANO
+                                              : mlog::TimePrecision::MILLI);
+                break;
+            }
+        }
+    });
+
+    produce("pattern");
+    stop = true;
+    switcher.join();
+    mlog::get_logger("pattern").flush();
+
+    return check_file("pattern");
+}
+
+void write_config(const std::string &path, const std::string &content) {
+    std::ofstream fout(path, std::ios_base::trunc);
+    fout << content;
+}
+
+// 等待后台线程重新加载配置文件，最多等待5秒
+bool wait_reload(std::size_t count) {
+    for (int i = 0; i < 500 && MLogConfig::reload_count() < count; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return MLogConfig::reload_count() >= count;
+}
+
+// 其它线程写日志的同时修改配置文件，新的等级立即生效
+bool test_config() {
+    const std::string path = MLogFileManager::get_path_prefix() + "config.ini";
+    const std::string head = "level = info\n[config]\nformat = level_signature_time\n"
+                             "out = file\nfile = config.log\n";
+
+    // 配置文件以追加方式打开日志文件，先删除上一次运行的结果
+    std::filesystem::remove(MLogFileManager::get_path_prefix() + "config.log");
+    mlog::create_logger("config");
+
+    // 日志文件已经被其它logger使用，整个文件被拒绝，不会退出
+    write_config(path, "level = error\n[config]\nlevel = warn\nout = file\n"
+                       "file = registry.log\n");
+    bool ok = check(!mlog::watch_config(path), "reject a used log file");
+    ok = check(mlog::get_logger("config").get_level() == mlog::Level::info,
+               "nothing applied from a rejected config")
+         && ok;
+
+    write_config(path, head + "level = warn\n");
+    ok = check(mlog::watch_config(path), "watch config") && ok;
+    ok = check(mlog::get_logger("config").get_level() == mlog::Level::warn,
+               "initial level")
+         && ok;
+
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_num; ++t) {
+        threads.emplace_back([t, &stop]() {
+            for (int i = 0; !stop; ++i) {
+                mlog::debug("config") << " thread " << t << " line " << i << '\n';
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+    }
+
+    // 编辑器通常写入临时文件再替换
+    write_config(path + ".tmp", head + "level = debug\n");
+    std::rename((path + ".tmp").c_str(), path.c_str());
+    ok = check(wait_reload(1), "reload after rename") && ok;
+    ok = check(mlog::get_logger("config").get_level() == mlog::Level::debug,
+               "level after rename")
+         && ok;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    // 错误的文件被忽略
+    write_config(path, head + "level = loud\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    ok = check(MLogConfig::reload_count() == 1, "invalid config ignored") && ok;
+    ok = check(mlog::get_logger("config").get_level() == mlog::Level::debug,
+               "level after invalid config")
+         && ok;
+
+    // 删除等级之后恢复全局等级
+    write_config(path, head);
+    ok = check(wait_reload(2), "reload after write") && ok;
+    ok = check(mlog::get_logger("config").get_level() == mlog::Level::info,
+               "level after removal")
+         && ok;
+
+    stop = true;
+    for (auto &th : threads) th.join();
+    mlog::unwatch_config();
+    mlog::get_logger("config").flush();
+
+    std::ifstream fin(MLogFileManager::get_path_prefix() + "config.log");
+    std::size_t debug_lines = 0;
+    std::string line;
+    while (std::getline(fin, line)) {
+        if (line.rfind("[DEBUG]{config}[", 0) == 0) ++debug_lines;
+    }
+    mlog::out() << "config debug lines = " << debug_lines << '\n';
+    return check(debug_lines > 0, "debug lines after reload") && ok;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    mlog::init(PREFIX + std::string("/.mlog/"));
+    mlog::set_level_info();
+
+    mlog::create_logger("drop").link_file_trunc("drop.log").lock();
+
+    bool ok = test_sync();
+    ok = test_block("async", 1024) && ok;
+    ok = test_block("async_tiny", 2) && ok;
+    ok = test_mmap() && ok;
+#ifdef MLOG_HAS_MMAP
+    ok = test_mmap_recover() && ok;
+#endif
+    ok = test_drop(mlog::OverflowPolicy::DROP_NEWEST) && ok;
+    ok = test_drop(mlog::OverflowPolicy::DROP_OLDEST) && ok;
+    ok = test_judge() && ok;
+    ok = test_registry() && ok;
+    ok = test_pattern() && ok;
+    ok = test_config() && ok;
+
+    return ok ? 0 : 1;
+}
@@ -14,17 +14,31 @@
 
 #include "mlogtool.hpp"
 
+#include "mlogappend.hpp"
+#include "mlogasync.hpp"
+#include "mlogbinary.hpp"
+#include "mlogcompress.hpp"
+#include "mlogconfig.hpp"
+
 #include "mlogfilemanager.hpp"
 
 #include "mlogger.hpp"
 
 #include "mloggermanager.hpp"
 
+#include "mlogrecorder.hpp"
+#include "mlogsink.hpp"
+
+#include <string_view>
+
 /*
 这里有好几个单例，注意static变量最后的析构
 一个是单例的全局日志等级变量
-一个是单例的MLogFileManager
+一个是单例的MLogFileManager，也在MLoggerManager之前构造，它的析构会等待滚动的后台线程
 一个是单例的MLoggerManager，所有的MLogger对象在它的map中存在
+一个是单例的MLogAsync，在MLoggerManager之前构造，保证最后析构
+一个是单例的MLogRecorder，第一次注册飞行记录器时构造，析构时恢复原来的信号处理函数
+一个是单例的MLogConfig，第一次读取配置文件时构造，在MLoggerManager之前析构，析构时结束监视的后台线程
 */
 
 // 提升常用的接口到MLog类
@@ -32,6 +46,14 @@ class MLog {
 public:
     using Format = MLogTool::LogStartFormat;
     using Level = MLogTool::Level;
+    using TimePrecision = MLogTool::TimePrecision;
+    using OverflowPolicy = MLogAsync::OverflowPolicy;
+    using RotatePolicy = MLogFileManager::RotatePolicy;
+    using RotateInterval = MLogFileManager::RotateInterval;
+    using FlushPolicy = MLogFileManager::FlushPolicy;
+    using Encoding = MLogTool::Encoding;
+    using Record = MLogger::Record;
+    using LoggerHandle = MLoggerHandle;
 
     MLog() = delete;
     MLog(const MLog &) = delete;
@@ -46,11 +68,22 @@ public:
 
     static void set_level_error() { MLogTool::set_level(Level::error); }
 
+    // 单独设置某个logger的日志等级，例如 mlog::set_level("net", mlog::Level::warn)
+    static void set_level(std::string_view logger_name, Level level) {
+        MLoggerManager::get_logger(logger_name).set_level(level);
+    }
+
+    // 恢复某个logger使用全局日志等级
+    static void reset_level(std::string_view logger_name) {
+        MLoggerManager::get_logger(logger_name).reset_level();
+    }
+
     static MLogger &create_logger(const std::string &logger_name) {
         return MLoggerManager::create_logger(logger_name);
     }
 
-    static MLogger &get_logger(const std::string &logger_name) {
+    // 返回的logger可以保存为LoggerHandle，之后直接使用，不再按名称查找
+    static MLogger &get_logger(std::string_view logger_name) {
         return MLoggerManager::get_logger(logger_name);
     }
 
@@ -64,47 +97,181 @@ public:
 
     static void init() { MLoggerManager::init(std::string{}); }
 
+    // 开启异步模式，queue_capacity会向上取整为2的幂
+    static void init_async(std::size_t queue_capacity,
+                           OverflowPolicy policy = OverflowPolicy::BLOCK) {
+        MLoggerManager::init_async(queue_capacity, policy);
+    }
+
+    static void shutdown_async() { MLoggerManager::shutdown_async(); }
+
+    static MLogAsync::Stats async_stats() { return MLogAsync::stats(); }
+
+    // 给logger加上一个飞行记录器，在内存中保留最近的debug及以上的记录
+    // 致命信号、std::terminate或者dump_recent时写入file_name（不含路径前缀）
+    // logger自身的等级仍然起作用，需要记录debug时应当把其它输出换成较高等级的sink，例如
+    // mlog::get_logger("A").link_none().set_level(mlog::Level::debug)
+    //     .add_sink(console_sink_with_level_info);
+    static std::shared_ptr<MLogRingSink>
+    enable_flight_recorder(LoggerHandle logger, const std::string &file_name,
+                           std::size_t max_bytes, std::size_t max_records = 0) {
+        auto sink = std::make_shared<MLogRingSink>(max_bytes, max_records);
+        sink->set_level(Level::debug);
+        if (!MLogRecorder::add(sink, file_name)) return nullptr;
+
+        logger->add_sink(sink);
+        return sink;
+    }
+
+    // 立即写出所有飞行记录器，返回成功写出的个数
+    static std::size_t dump_recent() {
+        MLogAsync::drain();
+        return MLogRecorder::dump();
+    }
+
+    // 从INI文件读取logger的等级、格式和输出，之后在后台线程中监视这个文件
+    // 文件修改后立即应用新的等级，不需要重新启动，写日志的线程不加锁，文件格式见MLogConfig
+    // 读取失败时返回false，不会开始监视
+    static bool watch_config(const std::string &path) {
+        return MLogConfig::watch(path);
+    }
+
+    // 停止监视配置文件，已经应用的设置保持不变
+    static void unwatch_config() { MLogConfig::stop(); }
+
     static void show_detail() { MLoggerManager::show_detail(); }
 
     //----------------------------------------------------------------------------//
 
-    static MLogger &out() { return MLoggerManager::get_logger_cout(); }
+    // 每次调用开始一条新的记录，语句结束时整体输出
+
+    static Record out() { return Record{&MLoggerManager::get_logger_cout()}; }
 
-    static MLogger &debug() {
+    static Record debug() {
         return MLoggerManager::get_logger_when(Level::debug);
     }
 
-    static MLogger &info() {
+    static Record info() {
         return MLoggerManager::get_logger_when(Level::info);
     }
 
-    static MLogger &warn() {
+    static Record warn() {
         return MLoggerManager::get_logger_when(Level::warn);
     }
 
-    static MLogger &error() {
+    static Record error() {
         return MLoggerManager::get_logger_when(Level::error);
     }
 
-    static MLogger &out(const std::string &logger_name) {
-        return MLoggerManager::get_logger(logger_name);
+    // 按名称查找logger，字面量名称不需要构造临时的std::string
+
+    static Record out(std::string_view logger_name) {
+        return Record{&MLoggerManager::get_logger(logger_name)};
     }
 
-    static MLogger &debug(const std::string &logger_name) {
+    static Record debug(std::string_view logger_name) {
         return MLoggerManager::get_logger_when(Level::debug, logger_name);
     }
 
-    static MLogger &info(const std::string &logger_name) {
+    static Record info(std::string_view logger_name) {
         return MLoggerManager::get_logger_when(Level::info, logger_name);
     }
 
-    static MLogger &warn(const std::string &logger_name) {
+    static Record warn(std::string_view logger_name) {
         return MLoggerManager::get_logger_when(Level::warn, logger_name);
     }
 
-    static MLogger &error(const std::string &logger_name) {
+    static Record error(std::string_view logger_name) {
         return MLoggerManager::get_logger_when(Level::error, logger_name);
     }
+
+    // 直接使用保存下来的句柄，没有任何查找
+
+    static Record out(LoggerHandle logger) { return Record{&logger.get()}; }
+
+    static Record debug(LoggerHandle logger) {
+        return MLoggerManager::get_logger_when(Level::debug, logger.get());
+    }
+
+    static Record info(LoggerHandle logger) {
+        return MLoggerManager::get_logger_when(Level::info, logger.get());
+    }
+
+    static Record warn(LoggerHandle logger) {
+        return MLoggerManager::get_logger_when(Level::warn, logger.get());
+    }
+
+    static Record error(LoggerHandle logger) {
+        return MLoggerManager::get_logger_when(Level::error, logger.get());
+    }
+
+    // 二进制日志的入口，通常通过MLOG_BINARY_*宏调用
+    // SiteFn是调用点唯一的lambda，用于只注册一次调用点
+    template <typename SiteFn, typename... Args>
+    static void binary(std::string_view logger_name, SiteFn site_fn,
+                       const char *format, const Args &...args) {
+        binary(LoggerHandle{MLoggerManager::get_logger(logger_name)}, site_fn,
+               format, args...);
+    }
+
+    template <typename SiteFn, typename... Args>
+    static void binary(LoggerHandle handle, SiteFn /*site_fn*/,
+                       const char * /*format*/, const Args &...args) {
+        const MLogBinary::SiteInfo info = SiteFn{}();
+        MLogger &logger = handle.get();
+        if (!logger.level_enabled(info.level)) return;
+
+        const std::uint32_t id = MLogBinary::site_id<SiteFn, Args...>();
+        logger.log_binary(id, info, args...);
+    }
+
+#ifdef MLOG_HAS_FORMAT
+    //----------------------------------------------------------------------------//
+    // std::format风格的接口，每次调用输出一整行
+    // 例如 mlog::info("A", "req {} took {} us", id, us)
+    // 得到 [INFO]{A} req 42 took 17 us
+    // 使用句柄时可以写成 mlog::info(handle).format(...)
+
+    template <typename... Args>
+    static void out(std::string_view logger_name,
+                    std::format_string<Args...> fmt, Args &&...args) {
+        out(logger_name).format(fmt, std::forward<Args>(args)...) << '\n';
+    }
+
+    template <typename... Args>
+    static void debug(std::string_view logger_name,
+                      std::format_string<Args...> fmt, Args &&...args) {
+        log_format(Level::debug, logger_name, fmt, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    static void info(std::string_view logger_name,
+                     std::format_string<Args...> fmt, Args &&...args) {
+        log_format(Level::info, logger_name, fmt, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    static void warn(std::string_view logger_name,
+                     std::format_string<Args...> fmt, Args &&...args) {
+        log_format(Level::warn, logger_name, fmt, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    static void error(std::string_view logger_name,
+                      std::format_string<Args...> fmt, Args &&...args) {
+        log_format(Level::error, logger_name, fmt, std::forward<Args>(args)...);
+    }
+
+private:
+    template <typename... Args>
+    static void log_format(Level level, std::string_view logger_name,
+                           std::format_string<Args...> fmt, Args &&...args) {
+        auto record = MLoggerManager::get_logger_when(level, logger_name);
+        if (record.active()) {
+            (record << ' ').format(fmt, std::forward<Args>(args)...) << '\n';
+        }
+    }
+#endif
 };
 
 // 加入一个别名，并且是小写的
@@ -16,29 +16,111 @@
 #define MLOG_USE_MACRO_LEVEL
 #endif
 
+// 判断等级是否可能需要输出，只和所有logger中最低的等级比较，每个logger自己的等级随后再判断
+// 使用宏设置等级时是常量表达式，被过滤的语句在编译期就被消除
+// 此时logger单独设置的等级不能低于MLOG_LEVEL
+#ifdef MLOG_USE_MACRO_LEVEL
+#define MLOG_LEVEL_ENABLED(level) (MLOG_LEVEL <= (level))
+#else
+#define MLOG_LEVEL_ENABLED(level) (MLogTool::get_level_floor() <= (level))
+#endif
+
+// 等级被过滤时只有一次分支判断，<<右侧的所有参数都不会被求值
+#define MLOG_IF_LEVEL(level)                                                   \
+    if (!(MLOG_LEVEL_ENABLED(level))) {}                                       \
+    else
+
+// 在调用点声明一份静态的元数据mlog_site，常量初始化，没有运行时开销
+#define MLOG_WITH_SITE(level)                                                  \
+    if (static constexpr MLogSite mlog_site{std::source_location::current(),   \
+                                            __func__, (level)};                \
+        false) {}                                                              \
+    else
+
+// 先创建记录，只有记录会被输出时才继续，logger单独设置的等级过滤时同样不会对参数求值
+// 记录在整个if语句结束时提交，与直接写在一条语句中的效果相同
+#define MLOG_WITH_RECORD(record_expr)                                          \
+    if (MLog::Record mlog_record = (record_expr); !mlog_record.active()) {}    \
+    else
+
 //----------------------------------------------------------------------------//
 
-#define MLOG_STAMP                                                             \
-    "[" + std::string(static_cast<const char *>(__FILE__)) + " "               \
-        + std::string(static_cast<const char *>(__FUNCTION__)) + " "           \
-        + std::to_string(__LINE__) + "]\n"
+// 调用点信息，临时对象在插入时立即写入记录
+#define MLOG_STAMP (MLogSite{std::source_location::current(), __func__})
+
+// MLOG_DEBUG等展开为if语句，之后只能接<<组成一条完整的语句
+// 不能加括号或者作为子表达式使用，例如 (MLOG_INFO("A") << x) 无法编译
+#define MLOG_DEBUG(...)                                                        \
+    MLOG_IF_LEVEL(MLOG_LEVEL_DEBUG)                                            \
+    MLOG_WITH_SITE(MLOG_LEVEL_DEBUG)                                           \
+    MLOG_WITH_RECORD(MLog::debug(__VA_ARGS__)) mlog_record << mlog_site
+#define MLOG_INFO(...)                                                         \
+    MLOG_IF_LEVEL(MLOG_LEVEL_INFO)                                             \
+    MLOG_WITH_SITE(MLOG_LEVEL_INFO)                                            \
+    MLOG_WITH_RECORD(MLog::info(__VA_ARGS__)) mlog_record << mlog_site
+#define MLOG_WARN(...)                                                         \
+    MLOG_IF_LEVEL(MLOG_LEVEL_WARN)                                             \
+    MLOG_WITH_SITE(MLOG_LEVEL_WARN)                                            \
+    MLOG_WITH_RECORD(MLog::warn(__VA_ARGS__)) mlog_record << mlog_site
+#define MLOG_ERROR(...)                                                        \
+    MLOG_IF_LEVEL(MLOG_LEVEL_ERROR)                                            \
+    MLOG_WITH_SITE(MLOG_LEVEL_ERROR)                                           \
+    MLOG_WITH_RECORD(MLog::error(__VA_ARGS__)) mlog_record << mlog_site
+
+// 二进制日志，例如 MLOG_BINARY_INFO("A", "req {} took {} us", id, us)
+// 只支持整数、浮点数、bool、char和字符串参数，格式字符串必须是字面量
+#define MLOG_BINARY_EXPAND(x) x
+#define MLOG_BINARY_FORMAT(format, ...) format
+
+#define MLOG_BINARY(level, logger_name, ...)                                   \
+    MLOG_IF_LEVEL(level)                                                       \
+    MLog::binary(                                                              \
+        (logger_name),                                                         \
+        [] {                                                                   \
+            return MLogBinary::SiteInfo{                                       \
+                (level),                                                       \
+                MLOG_BINARY_EXPAND(MLOG_BINARY_FORMAT(__VA_ARGS__))};          \
+        },                                                                     \
+        __VA_ARGS__)
+
+#define MLOG_BINARY_DEBUG(logger_name, ...)                                    \
+    MLOG_BINARY(MLOG_LEVEL_DEBUG, logger_name, __VA_ARGS__)
+#define MLOG_BINARY_INFO(logger_name, ...)                                     \
+    MLOG_BINARY(MLOG_LEVEL_INFO, logger_name, __VA_ARGS__)
+#define MLOG_BINARY_WARN(logger_name, ...)                                     \
+    MLOG_BINARY(MLOG_LEVEL_WARN, logger_name, __VA_ARGS__)
+#define MLOG_BINARY_ERROR(logger_name, ...)                                    \
+    MLOG_BINARY(MLOG_LEVEL_ERROR, logger_name, __VA_ARGS__)
+
+#define MLOG_CONCAT_DETAIL(a, b) a##b
+#define MLOG_CONCAT(a, b) MLOG_CONCAT_DETAIL(a, b)
+
+// 在调用点声明一个静态的判断对象，多个线程可以同时使用
+// 语句内部可以通过mlog_pass.suppressed得到上一次通过之后被跳过的次数
+#define MLOG_IF_JUDGE(type, ...)                                               \
+    static auto MLOG_CONCAT(mlog_tmp_judge_, __LINE__) =                       \
+        MLogTool::type(__VA_ARGS__);                                           \
+    if (const MLogTool::Judgement mlog_pass =                                  \
+            MLOG_CONCAT(mlog_tmp_judge_, __LINE__).judge();                    \
+        mlog_pass)
+
+#define MLOG_IF_FIRST_N(x) MLOG_IF_JUDGE(FirstN, (x))
+
+#define MLOG_IF_EVERY_N(x) MLOG_IF_JUDGE(EveryN, (x))
 
-#define MLOG_DEBUG(...) (MLog::debug(__VA_ARGS__) << MLOG_STAMP)
-#define MLOG_INFO(...) (MLog::info(__VA_ARGS__) << MLOG_STAMP)
-#define MLOG_WARN(...) (MLog::warn(__VA_ARGS__) << MLOG_STAMP)
-#define MLOG_ERROR(...) (MLog::error(__VA_ARGS__) << MLOG_STAMP)
+#define MLOG_IF_MORETHAN_N(x) MLOG_IF_JUDGE(MoreThanN, (x))
 
-#define MLOG_IF_FIRST_N(x)                                                     \
-    static auto mlog_tmp_first_##x = MLogTool::FirstN((x));                    \
-    if (mlog_tmp_first_##x.judge())
+// 每隔至少ms毫秒通过一次
+#define MLOG_EVERY_MS(ms) MLOG_IF_JUDGE(EveryMs, (ms))
 
-#define MLOG_IF_EVERY_N(x)                                                     \
-    static auto mlog_tmp_every_##x = MLogTool::EveryN((x));                    \
-    if (mlog_tmp_every_##x.judge())
+// 令牌桶限流，平均每秒per_sec次，最多连续burst次
+// per_sec不是正数时只有最初的burst次通过，burst为0时按1处理
+// 例如 MLOG_RATE_LIMIT(10, 20) { MLOG_ERROR("A") << "io failed\n"; }
+#define MLOG_RATE_LIMIT(per_sec, burst)                                        \
+    MLOG_IF_JUDGE(RateLimit, (per_sec), (burst))
 
-#define MLOG_IF_MORETHAN_N(x)                                                  \
-    static auto mlog_tmp_morethan_##x = MLogTool::MoreThanN((x));              \
-    if (mlog_tmp_morethan_##x.judge())
+// 以概率p通过
+#define MLOG_SAMPLE(p) MLOG_IF_JUDGE(Sample, (p))
 
 // 加一个临时性跳过某个函数的功能，但是会在控制台发出提示
 #define MLOG_SKIP(...)                                                         \
@@ -0,0 +1,69 @@
+#ifndef MLOGAPPEND_H_
+#define MLOGAPPEND_H_
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MLOG_HAS_O_APPEND
+#endif
+
+#ifdef MLOG_HAS_O_APPEND
+
+#include "mlogsink.hpp"
+
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// 多个进程共享的日志文件，例如预先fork的多个工作进程写同一个服务日志
+// 以O_APPEND打开，每条完整的记录只调用一次write，不经过ofstream的缓冲区，
+// 因此记录不会在任意位置被切断，也不需要收集进程或者文件锁
+//
+// 不超过max_atomic_size字节的记录保证不会和其它进程的记录交错（本地文件系统）
+// 更长的记录仍然只调用一次write，但是不再保证，网络文件系统（例如NFS）上没有任何保证
+// 文件不经过MLogFileManager登记，同一个进程中的多个sink也可以指向同一个文件
+class MLogAppendSink : public MLogSink {
+public:
+    constexpr static std::size_t max_atomic_size = 4096;
+
+    // file_name不含路径前缀
+    explicit MLogAppendSink(const std::string &file_name)
+        : m_path(MLogFileManager::get_path_prefix() + file_name),
+          m_fd(::open(m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, // NOLINT(hicpp-signed-bitwise)
+                      0644)) {}
+
+    ~MLogAppendSink() override {
+        if (m_fd >= 0) ::close(m_fd);
+    }
+
+    // 打开失败时返回false，此时所有记录都被丢弃
+    bool is_open() const { return m_fd >= 0; }
+
+    const std::string &path() const { return m_path; }
+
+    // 记录直接交给内核，不需要加锁；只有被信号中断或者磁盘已满时才会分多次写入
+    void write(const MLogRecordView &record) override {
+        if (m_fd < 0) return;
+
+        std::string_view text = payload(record);
+        while (!text.empty()) {
+            const ::ssize_t n = ::write(m_fd, text.data(), text.size());
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;
+            text.remove_prefix(static_cast<std::size_t>(n));
+        }
+    }
+
+    // 写入之后已经在内核中，其它进程立即可见，不需要冲刷
+    void flush() override {}
+
+private:
+    std::string m_path;
+    int m_fd;
+};
+
+#endif  // MLOG_HAS_O_APPEND
+
+#endif  // MLOGAPPEND_H_
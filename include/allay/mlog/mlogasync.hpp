@@ -0,0 +1,332 @@
+#ifndef MLOGASYNC_H_
+#define MLOGASYNC_H_
+
+#include "mlogtool.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+
+class MLogger;
+struct MLogSite;
+
+// 有界的多生产者多消费者环形队列（Vyukov算法）
+// 每个槽位带一个序号，生产者和消费者都只通过CAS推进各自的位置，不加锁
+// 容量会向上取整为2的幂
+template <typename T>
+class MLogRingQueue {
+public:
+    explicit MLogRingQueue(std::size_t capacity)
+        : m_capacity(round_up(capacity)), m_mask(m_capacity - 1),
+          m_cells(std::make_unique<Cell[]>(m_capacity)) {
+        for (std::size_t i = 0; i < m_capacity; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MLogRingQueue(const MLogRingQueue &) = delete;
+    MLogRingQueue &operator=(const MLogRingQueue &) = delete;
+
+    // 入队和出队都与槽位交换内容而不是移动，槽位中留下的缓冲区会被下一次入队取回
+    // 因此在队列转过一圈之后，字符串等缓冲区在生产者和后台线程之间循环使用，不再分配
+
+    // 队列已满时返回false，value保持不变
+    bool try_push(T &value) {
+        std::size_t pos = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &cell = m_cells[pos & m_mask];
+            std::size_t seq = cell.seq.load(std::memory_order_acquire);
+            if (seq == pos) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed)) {
+                    using std::swap;
+                    swap(cell.value, value);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (seq < pos) {
+                return false;  // 这个槽位还没有被消费，队列已满
+            }
+            else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // 队列为空时返回false
+    bool try_pop(T &value) {
+        std::size_t pos = m_head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &cell = m_cells[pos & m_mask];
+            std::size_t seq = cell.seq.load(std::memory_order_acquire);
+            if (seq == pos + 1) {
+                if (m_head.compare_exchange_weak(pos, pos + 1,
+                                                 std::memory_order_relaxed)) {
+                    using std::swap;
+                    swap(cell.value, value);
+                    cell.seq.store(pos + m_capacity, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (seq < pos + 1) {
+                return false;  // 这个槽位还没有被写入，队列为空
+            }
+            else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // 已经出队的位置，单调递增
+    std::size_t head() const { return m_head.load(std::memory_order_acquire); }
+
+    // 已经预定的入队位置，单调递增
+    std::size_t tail() const { return m_tail.load(std::memory_order_acquire); }
+
+    std::size_t capacity() const { return m_capacity; }
+
+    // 下一个入队位置的槽位还没有被消费
+    bool full() const {
+        const std::size_t pos = m_tail.load(std::memory_order_relaxed);
+        return m_cells[pos & m_mask].seq.load(std::memory_order_acquire) < pos;
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> seq{0};
+        T value{};
+    };
+
+    static std::size_t round_up(std::size_t capacity) {
+        std::size_t result = 2;
+        while (result < capacity) result <<= 1;
+        return result;
+    }
+
+    const std::size_t m_capacity;
+    const std::size_t m_mask;
+    std::unique_ptr<Cell[]> m_cells;
+
+    alignas(64) std::atomic<std::size_t> m_head{0};
+    alignas(64) std::atomic<std::size_t> m_tail{0};
+};
+
+// 异步日志后端，单例
+// 生产者只负责把格式化好的记录放进有界队列，由唯一的后台线程写入cout和文件流
+class MLogAsync {
+public:
+    // 队列满时的处理策略
+    enum class OverflowPolicy {
+        BLOCK = 0,    // 等待后台线程腾出空间
+        DROP_NEWEST,  // 丢弃当前这条记录
+        DROP_OLDEST,  // 丢弃队列中最旧的记录，再放入当前记录
+    };
+
+    // 一条待写出的记录，logger为空时不写任何内容
+    struct Item {
+        MLogger *logger{nullptr};
+        std::string text;
+        std::string json;            // JSON模式的logger的结构化记录
+        const char *color{nullptr};  // 开头color_len个字符在cout上着色
+        std::size_t color_len{0};
+        const MLogSite *site{nullptr};  // 调用点元数据，由后台线程展开
+        std::size_t site_pos{0};
+        MLogTool::Level level{MLogTool::Level::on};
+        bool use_cout{false};
+        bool use_file{false};
+        bool flush{false};
+        bool binary{false};  // text是一条二进制日志记录
+
+        // 字符串至少预留的容量，调用点信息在后台线程中插入，也不需要扩容
+        constexpr static std::size_t min_capacity = 256;
+
+        // 恢复默认值，保留字符串的容量
+        void reset(MLogger *owner) {
+            logger = owner;
+            text.clear();
+            text.reserve(min_capacity);
+            json.clear();
+            json.reserve(min_capacity);
+            color = nullptr;
+            color_len = 0;
+            site = nullptr;
+            site_pos = 0;
+            level = MLogTool::Level::on;
+            use_cout = false;
+            use_file = false;
+            flush = false;
+            binary = false;
+        }
+    };
+
+    struct Stats {
+        std::uint64_t enqueued{0};        // 成功入队的记录数
+        std::uint64_t written{0};         // 后台线程写出的记录数
+        std::uint64_t dropped_newest{0};  // DROP_NEWEST丢弃的记录数
+        std::uint64_t dropped_oldest{0};  // DROP_OLDEST丢弃的记录数
+        std::uint64_t blocked{0};         // BLOCK策略下等待过的次数
+    };
+
+    MLogAsync(const MLogAsync &) = delete;
+    MLogAsync &operator=(const MLogAsync &) = delete;
+
+    // 启动后台线程，consumer在后台线程中逐条处理记录
+    // 已经启动时直接返回
+    template <typename Consumer>
+    static void start(std::size_t capacity, OverflowPolicy policy,
+                      Consumer consumer) {
+        auto &inst = get_instance();
+        if (inst.m_enabled.load(std::memory_order_acquire)) return;
+
+        inst.m_queue = std::make_unique<MLogRingQueue<Item>>(capacity);
+        inst.m_policy = policy;
+        inst.m_done.store(0, std::memory_order_release);
+        inst.m_running.store(true, std::memory_order_release);
+        inst.m_writer = std::thread([&inst, consumer]() mutable {
+            inst.writer_loop(consumer);
+        });
+        inst.m_enabled.store(true, std::memory_order_release);
+    }
+
+    // 写出队列中剩余的全部记录，然后结束后台线程，之后的日志恢复同步写出
+    // 应当在没有其它线程继续写日志时调用
+    static void stop() {
+        auto &inst = get_instance();
+        if (!inst.m_enabled.load(std::memory_order_acquire)) return;
+
+        drain();
+        inst.m_enabled.store(false, std::memory_order_release);
+        inst.m_running.store(false, std::memory_order_release);
+        inst.signal();
+        if (inst.m_writer.joinable()) inst.m_writer.join();
+    }
+
+    static bool enabled() {
+        return get_instance().m_enabled.load(std::memory_order_acquire);
+    }
+
+    // 放入一条记录，队列满时按照策略处理
+    // 入队之后item中是槽位原有的内容，调用者可以重用它的缓冲区
+    static void push(Item &item) {
+        auto &inst = get_instance();
+        auto &queue = *inst.m_queue;
+
+        while (!queue.try_push(item)) {
+            switch (inst.m_policy) {
+            case OverflowPolicy::DROP_NEWEST:
+                inst.m_dropped_newest.fetch_add(1, std::memory_order_relaxed);
+                return;
+            case OverflowPolicy::DROP_OLDEST: {
+                Item oldest;
+                if (queue.try_pop(oldest)) {
+                    inst.m_dropped_oldest.fetch_add(1,
+                                                    std::memory_order_relaxed);
+                }
+                break;
+            }
+            case OverflowPolicy::BLOCK:
+            default: {
+                // 先读取m_done再确认队列仍然是满的，之后后台线程出队时一定会更新m_done
+                // 因此不会错过唤醒；队列已经有空位时直接重试
+                inst.m_blocked.fetch_add(1, std::memory_order_relaxed);
+                const std::size_t done =
+                    inst.m_done.load(std::memory_order_acquire);
+                inst.signal();
+                if (queue.full()) {
+                    inst.m_done.wait(done, std::memory_order_acquire);
+                }
+                break;
+            }
+            }
+        }
+
+        inst.m_enqueued.fetch_add(1, std::memory_order_relaxed);
+        inst.signal();
+    }
+
+    // 等待调用时刻之前入队的所有记录被写出（或者被丢弃）
+    // 在后台线程内部调用时直接返回
+    static void drain() {
+        auto &inst = get_instance();
+        if (!inst.m_enabled.load(std::memory_order_acquire)) return;
+        if (std::this_thread::get_id() == inst.m_writer.get_id()) return;
+
+        const std::size_t target = inst.m_queue->tail();
+        for (;;) {
+            std::size_t done = inst.m_done.load(std::memory_order_acquire);
+            if (inst.m_queue->head() >= target && done >= target) return;
+            inst.signal();
+            inst.m_done.wait(done, std::memory_order_acquire);
+        }
+    }
+
+    static Stats stats() {
+        auto &inst = get_instance();
+        return Stats{inst.m_enqueued.load(std::memory_order_relaxed),
+                     inst.m_written.load(std::memory_order_relaxed),
+                     inst.m_dropped_newest.load(std::memory_order_relaxed),
+                     inst.m_dropped_oldest.load(std::memory_order_relaxed),
+                     inst.m_blocked.load(std::memory_order_relaxed)};
+    }
+
+    static MLogAsync &get_instance() {
+        static MLogAsync the_async_backend;
+        return the_async_backend;
+    }
+
+private:
+    MLogAsync() = default;
+
+    ~MLogAsync() { stop(); }
+
+    void signal() {
+        m_signal.fetch_add(1, std::memory_order_release);
+        m_signal.notify_one();
+    }
+
+    // 后台线程主循环
+    // m_done记录后台线程不会再处理的最小位置：每次尝试出队之前更新为当前head，
+    // 因此正在写出的记录一定位于m_done之后，drain据此判断是否完成
+    // BLOCK策略下等待空位的生产者也在m_done上等待
+    template <typename Consumer>
+    void writer_loop(Consumer &consumer) {
+        Item item;
+        for (;;) {
+            std::uint64_t seen = m_signal.load(std::memory_order_acquire);
+
+            for (;;) {
+                m_done.store(m_queue->head(), std::memory_order_release);
+                m_done.notify_all();
+                if (!m_queue->try_pop(item)) break;
+
+                if (item.logger != nullptr) consumer(item);
+                m_written.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            if (!m_running.load(std::memory_order_acquire)) return;
+            m_signal.wait(seen, std::memory_order_acquire);
+        }
+    }
+
+    std::unique_ptr<MLogRingQueue<Item>> m_queue;
+    OverflowPolicy m_policy{OverflowPolicy::BLOCK};
+    std::thread m_writer;
+
+    std::atomic<bool> m_enabled{false};
+    std::atomic<bool> m_running{false};
+    std::atomic<std::uint64_t> m_signal{0};
+    std::atomic<std::size_t> m_done{0};
+
+    std::atomic<std::uint64_t> m_enqueued{0};
+    std::atomic<std::uint64_t> m_written{0};
+    std::atomic<std::uint64_t> m_dropped_newest{0};
+    std::atomic<std::uint64_t> m_dropped_oldest{0};
+    std::atomic<std::uint64_t> m_blocked{0};
+};
+
+#endif  // MLOGASYNC_H_
@@ -0,0 +1,500 @@
+#ifndef MLOGBINARY_H_
+#define MLOGBINARY_H_
+
+#include "mlogtool.hpp"
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// 二进制日志格式，格式化推迟到离线解码时进行
+// 每个调用点的格式字符串和参数类型只注册一次并分配一个id
+// 写日志时只写入id，时间戳和参数的原始字节，由mlog_decode还原成文本
+//
+// 文件结构（整数均为主机字节序，文件头记录了字节序标记）：
+// 文件头  magic[8] version(u32) endian(u32) format(u8) precision(u8)
+//         name_len(u16) name
+// 调用点  'S' id(u32) level(u8) arg_num(u8) types(u8 * arg_num)
+//         format_len(u32) format
+// 日志    'L' id(u32) time(i64, 纳秒) args
+// 文本    'T' len(u32) text，用于普通的文本记录，例如MLOG START
+// 字符串参数写成 len(u32) bytes，其它参数按照类型写入定长的原始字节
+class MLogBinary {
+public:
+    using Level = MLogTool::Level;
+    using Format = MLogTool::LogStartFormat;
+    using TimePrecision = MLogTool::TimePrecision;
+
+    enum class ArgType : std::uint8_t {
+        I32 = 1,
+        I64,
+        U32,
+        U64,
+        F64,
+        BOOL,
+        CHAR,
+        STR,
+    };
+
+    constexpr static char magic[8] = {'M', 'L', 'O', 'G', 'B', 'I', 'N', '\0'};
+    constexpr static std::uint32_t version = 1;
+    constexpr static std::uint32_t endian_mark = 0x01020304;
+    constexpr static std::uint32_t invalid_id = 0xFFFFFFFF;
+
+    constexpr static char tag_site = 'S';
+    constexpr static char tag_log = 'L';
+    constexpr static char tag_text = 'T';
+
+    // 调用点的定义
+    struct SiteDef {
+        Level level{Level::on};
+        std::string format;
+        std::vector<ArgType> types;
+    };
+
+    // 调用点的静态信息，由MLOG_BINARY宏中的lambda返回
+    struct SiteInfo {
+        Level level;
+        const char *format;
+    };
+
+    //----------------------------------------------------------------------------//
+    // 调用点注册
+
+    template <typename T>
+    constexpr static ArgType arg_type() {
+        if constexpr (std::is_same_v<T, bool>) { return ArgType::BOOL; }
+        else if constexpr (std::is_same_v<T, char>) { return ArgType::CHAR; }
+        else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            return (sizeof(T) <= 4) ? ArgType::I32 : ArgType::I64;
+        }
+        else if constexpr (std::is_integral_v<T>) {
+            return (sizeof(T) <= 4) ? ArgType::U32 : ArgType::U64;
+        }
+        else if constexpr (std::is_floating_point_v<T>) { return ArgType::F64; }
+        else {
+            static_assert(std::is_convertible_v<T, std::string_view>,
+                          "MLogBinary: unsupported argument type");
+            return ArgType::STR;
+        }
+    }
+
+    // 注册一个调用点，返回它的id，每个调用点只会调用一次
+    template <typename... Args>
+    static std::uint32_t register_site(SiteInfo info) {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        registry().push_back(
+            SiteDef{info.level, info.format, {arg_type<std::decay_t<Args>>()...}});
+        return static_cast<std::uint32_t>(registry().size() - 1);
+    }
+
+    // 每个调用点对应的SiteFn是一个不同的lambda类型，因此静态变量只初始化一次
+    template <typename SiteFn, typename... Args>
+    static std::uint32_t site_id() {
+        static const std::uint32_t id = register_site<Args...>(SiteFn{}());
+        return id;
+    }
+
+    static SiteDef site(std::uint32_t id) {
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        return (id < registry().size()) ? registry()[id] : SiteDef{};
+    }
+
+    // 保证注册表先于MLoggerManager构造，从而在logger析构之后才析构
+    static void prepare() {
+        registry();
+        registry_mutex();
+    }
+
+    //----------------------------------------------------------------------------//
+    // 编码
+
+    static void encode_header(std::string &out, const std::string &name,
+                              Format format, TimePrecision precision) {
+        out.append(static_cast<const char *>(magic), sizeof(magic));
+        put(out, version);
+        put(out, endian_mark);
+        put(out, static_cast<std::uint8_t>(format));
+        put(out, static_cast<std::uint8_t>(precision));
+        put(out, static_cast<std::uint16_t>(name.size()));
+        out.append(name);
+    }
+
+    static void encode_site(std::string &out, std::uint32_t id,
+                            const SiteDef &def) {
+        out.push_back(tag_site);
+        put(out, id);
+        put(out, static_cast<std::uint8_t>(def.level));
+        put(out, static_cast<std::uint8_t>(def.types.size()));
+        for (auto type : def.types) put(out, static_cast<std::uint8_t>(type));
+        put(out, static_cast<std::uint32_t>(def.format.size()));
+        out.append(def.format);
+    }
+
+    template <typename... Args>
+    static void encode_log(std::string &out, std::uint32_t id,
+                           std::int64_t time_ns, const Args &...args) {
+        out.push_back(tag_log);
+        put(out, id);
+        put(out, time_ns);
+        (encode_arg(out, args), ...);
+    }
+
+    static void encode_text(std::string &out, std::string_view text) {
+        out.push_back(tag_text);
+        put(out, static_cast<std::uint32_t>(text.size()));
+        out.append(text);
+    }
+
+    // 日志记录的id位于tag之后
+    static std::uint32_t log_id(const std::string &record) {
+        std::uint32_t id = invalid_id;
+        if (record.size() > sizeof(id) && record.front() == tag_log) {
+            std::memcpy(&id, record.data() + 1, sizeof(id));
+        }
+        return id;
+    }
+
+    // 在线格式化，用于非二进制模式的logger，结果与解码得到的文本一致
+    template <typename... Args>
+    static void format_text(std::string &out, std::string_view format,
+                            const Args &...args) {
+        std::size_t arg_index = 0;
+        auto append_nth = [&out](std::size_t index, const auto &...values) {
+            std::size_t n = 0;
+            ((n++ == index ? append_arg(out, values) : void()), ...);
+        };
+
+        for (std::size_t i = 0; i < format.size(); ++i) {
+            const char ch = format[i];
+            if ((ch == '{' || ch == '}') && i + 1 < format.size()
+                && format[i + 1] == ch) {
+                out.push_back(ch);
+                ++i;
+            }
+            else if (ch == '{') {
+                const std::size_t close = format.find('}', i);
+                if (close == std::string_view::npos) break;
+                append_nth(arg_index++, args...);
+                i = close;
+            }
+            else {
+                out.push_back(ch);
+            }
+        }
+
+        while (arg_index < sizeof...(Args)) {
+            out.push_back(' ');
+            append_nth(arg_index++, args...);
+        }
+    }
+
+    //----------------------------------------------------------------------------//
+    // 解码
+
+    // 把整个二进制日志还原为与文本日志相同的格式，格式错误时返回false
+    static bool decode(std::istream &in, std::ostream &out) {
+        char file_magic[sizeof(magic)]{};
+        std::uint32_t file_version = 0;
+        std::uint32_t file_endian = 0;
+        std::uint8_t format = 0;
+        std::uint8_t precision = 0;
+        std::uint16_t name_len = 0;
+
+        in.read(static_cast<char *>(file_magic), sizeof(file_magic));
+        if (!in || std::memcmp(file_magic, magic, sizeof(magic)) != 0
+            || !get(in, file_version) || file_version != version
+            || !get(in, file_endian) || file_endian != endian_mark
+            || !get(in, format) || !get(in, precision) || !get(in, name_len)) {
+            return false;
+        }
+
+        std::string name(name_len, '\0');
+        if (!in.read(name.data(), name_len)) return false;
+
+        const std::string signature = "{" + name + "}";
+        const auto log_format = static_cast<Format>(format);
+        const auto time_precision = static_cast<TimePrecision>(precision);
+
+        std::vector<SiteDef> sites;
+        std::string line;
+        char tag = 0;
+        while (in.get(tag)) {
+            line.clear();
+            switch (tag) {
+            case tag_site: {
+                std::uint32_t id = 0;
+                std::uint8_t level = 0;
+                std::uint8_t arg_num = 0;
+                std::uint32_t format_len = 0;
+                if (!get(in, id) || !get(in, level) || !get(in, arg_num))
+                    return false;
+
+                SiteDef def;
+                def.level = static_cast<Level>(level);
+                for (std::uint8_t i = 0; i < arg_num; ++i) {
+                    std::uint8_t type = 0;
+                    if (!get(in, type)) return false;
+                    def.types.push_back(static_cast<ArgType>(type));
+                }
+                if (!get(in, format_len)) return false;
+                def.format.resize(format_len);
+                if (!in.read(def.format.data(), format_len)) return false;
+
+                if (sites.size() <= id) sites.resize(id + 1);
+                sites[id] = std::move(def);
+                break;
+            }
+            case tag_log: {
+                std::uint32_t id = 0;
+                std::int64_t time_ns = 0;
+                if (!get(in, id) || !get(in, time_ns) || id >= sites.size())
+                    return false;
+
+                const SiteDef &def = sites[id];
+                write_start(line, def.level, log_format, signature, time_ns,
+                            time_precision);
+                line.push_back(' ');
+                if (!decode_message(in, def, line)) return false;
+                line.push_back('\n');
+                break;
+            }
+            case tag_text: {
+                std::uint32_t len = 0;
+                if (!get(in, len)) return false;
+                line.resize(len);
+                if (!in.read(line.data(), len)) return false;
+                break;
+            }
+            default: return false;
+            }
+            out.write(line.data(), static_cast<std::streamsize>(line.size()));
+        }
+        return true;
+    }
+
+private:
+    template <typename T>
+    static void put(std::string &out, T value) {
+        char bytes[sizeof(T)];
+        std::memcpy(static_cast<char *>(bytes), &value, sizeof(T));
+        out.append(static_cast<char *>(bytes), sizeof(T));
+    }
+
+    template <typename T>
+    static bool get(std::istream &in, T &value) {
+        char bytes[sizeof(T)];
+        if (!in.read(static_cast<char *>(bytes), sizeof(T))) return false;
+        std::memcpy(&value, static_cast<char *>(bytes), sizeof(T));
+        return true;
+    }
+
+    template <typename T>
+    static void encode_arg(std::string &out, const T &arg) {
+        constexpr ArgType type = arg_type<std::decay_t<T>>();
+        if constexpr (type == ArgType::BOOL || type == ArgType::CHAR) {
+            put(out, static_cast<std::uint8_t>(arg));
+        }
+        else if constexpr (type == ArgType::I32) {
+            put(out, static_cast<std::int32_t>(arg));
+        }
+        else if constexpr (type == ArgType::I64) {
+            put(out, static_cast<std::int64_t>(arg));
+        }
+        else if constexpr (type == ArgType::U32) {
+            put(out, static_cast<std::uint32_t>(arg));
+        }
+        else if constexpr (type == ArgType::U64) {
+            put(out, static_cast<std::uint64_t>(arg));
+        }
+        else if constexpr (type == ArgType::F64) {
+            put(out, static_cast<double>(arg));
+        }
+        else {
+            std::string_view str{arg};
+            put(out, static_cast<std::uint32_t>(str.size()));
+            out.append(str);
+        }
+    }
+
+    // 追加一个参数的文本形式，按照编码时的类型转换，与decode_arg一致
+    template <typename T>
+    static void append_arg(std::string &out, const T &arg) {
+        constexpr ArgType type = arg_type<std::decay_t<T>>();
+        if constexpr (type == ArgType::BOOL) {
+            out.append(arg ? "true" : "false");
+        }
+        else if constexpr (type == ArgType::CHAR) { out.push_back(arg); }
+        else if constexpr (type == ArgType::STR) {
+            out.append(std::string_view{arg});
+        }
+        else {
+            char digits[32];
+            char *first = static_cast<char *>(digits);
+            std::to_chars_result result{first, std::errc{}};
+            if constexpr (type == ArgType::I32) {
+                result = std::to_chars(first, first + sizeof(digits),
+                                       static_cast<std::int32_t>(arg));
+            }
+            else if constexpr (type == ArgType::I64) {
+                result = std::to_chars(first, first + sizeof(digits),
+                                       static_cast<std::int64_t>(arg));
+            }
+            else if constexpr (type == ArgType::U32) {
+                result = std::to_chars(first, first + sizeof(digits),
+                                       static_cast<std::uint32_t>(arg));
+            }
+            else if constexpr (type == ArgType::U64) {
+                result = std::to_chars(first, first + sizeof(digits),
+                                       static_cast<std::uint64_t>(arg));
+            }
+            else {
+                result = std::to_chars(first, first + sizeof(digits),
+                                       static_cast<double>(arg));
+            }
+            out.append(first, result.ptr);
+        }
+    }
+
+    // 读出一个参数并追加它的文本形式
+    static bool decode_arg(std::istream &in, ArgType type, std::string &out) {
+        char digits[32];
+        char *first = static_cast<char *>(digits);
+        char *last = first + sizeof(digits);
+        std::to_chars_result result{first, std::errc{}};
+
+        switch (type) {
+        case ArgType::BOOL: {
+            std::uint8_t value = 0;
+            if (!get(in, value)) return false;
+            out.append(value != 0 ? "true" : "false");
+            return true;
+        }
+        case ArgType::CHAR: {
+            std::uint8_t value = 0;
+            if (!get(in, value)) return false;
+            out.push_back(static_cast<char>(value));
+            return true;
+        }
+        case ArgType::I32: {
+            std::int32_t value = 0;
+            if (!get(in, value)) return false;
+            result = std::to_chars(first, last, value);
+            break;
+        }
+        case ArgType::I64: {
+            std::int64_t value = 0;
+            if (!get(in, value)) return false;
+            result = std::to_chars(first, last, value);
+            break;
+        }
+        case ArgType::U32: {
+            std::uint32_t value = 0;
+            if (!get(in, value)) return false;
+            result = std::to_chars(first, last, value);
+            break;
+        }
+        case ArgType::U64: {
+            std::uint64_t value = 0;
+            if (!get(in, value)) return false;
+            result = std::to_chars(first, last, value);
+            break;
+        }
+        case ArgType::F64: {
+            double value = 0;
+            if (!get(in, value)) return false;
+            result = std::to_chars(first, last, value);
+            break;
+        }
+        case ArgType::STR: {
+            std::uint32_t len = 0;
+            if (!get(in, len)) return false;
+            const std::size_t old_size = out.size();
+            out.resize(old_size + len);
+            return static_cast<bool>(in.read(out.data() + old_size, len));
+        }
+        default: return false;
+        }
+
+        out.append(first, result.ptr);
+        return true;
+    }
+
+    // 按照格式字符串依次替换{}，支持{{和}}转义，{}中的格式说明被忽略
+    static bool decode_message(std::istream &in, const SiteDef &def,
+                               std::string &out) {
+        const std::string &format = def.format;
+        std::size_t arg_index = 0;
+        for (std::size_t i = 0; i < format.size(); ++i) {
+            const char ch = format[i];
+            if ((ch == '{' || ch == '}') && i + 1 < format.size()
+                && format[i + 1] == ch) {
+                out.push_back(ch);
+                ++i;
+            }
+            else if (ch == '{') {
+                const std::size_t close = format.find('}', i);
+                if (close == std::string::npos) break;
+                if (arg_index < def.types.size()
+                    && !decode_arg(in, def.types[arg_index++], out)) {
+                    return false;
+                }
+                i = close;
+            }
+            else {
+                out.push_back(ch);
+            }
+        }
+
+        // 多余的参数追加在末尾，保证读取位置正确
+        while (arg_index < def.types.size()) {
+            out.push_back(' ');
+            if (!decode_arg(in, def.types[arg_index++], out)) return false;
+        }
+        return true;
+    }
+
+    // 与MLogger::write_start一致，但是时间来自记录本身，不输出颜色
+    static void write_start(std::string &out, Level level, Format format,
+                            const std::string &signature, std::int64_t time_ns,
+                            TimePrecision precision) {
+        const bool with_signature = (format == Format::LEVEL_SIGNATURE_TIME
+                                     || format == Format::LEVEL_SIGNATURE);
+        const bool with_time = (format == Format::LEVEL_SIGNATURE_TIME
+                                || format == Format::LEVEL_TIME);
+
+        if (format == Format::NONE) return;
+
+        out.append(MLogTool::level_stamp(level));
+        if (with_signature) out.append(signature);
+        if (with_time) {
+            char stamp[MLogTool::time_stamp_max_size];
+            std::chrono::system_clock::time_point time{
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                    std::chrono::nanoseconds{time_ns})};
+            out.append(static_cast<char *>(stamp),
+                       MLogTool::time_stamp(static_cast<char *>(stamp), time,
+                                            precision));
+        }
+    }
+
+    static std::deque<SiteDef> &registry() {
+        static std::deque<SiteDef> the_site_registry;
+        return the_site_registry;
+    }
+
+    static std::mutex &registry_mutex() {
+        static std::mutex the_registry_mutex;
+        return the_registry_mutex;
+    }
+};
+
+#endif  // MLOGBINARY_H_
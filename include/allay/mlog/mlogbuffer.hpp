@@ -0,0 +1,111 @@
+#ifndef MLOGBUFFER_H_
+#define MLOGBUFFER_H_
+
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// 直接追加到std::string末尾的streambuf，清空时保留容量
+class MLogStringBuf : public std::streambuf {
+public:
+    std::string &str() { return m_str; }
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            m_str.push_back(traits_type::to_char_type(ch));
+        }
+        return ch;
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        m_str.append(s, static_cast<std::size_t>(n));
+        return n;
+    }
+
+private:
+    std::string m_str;
+};
+
+// 一条日志记录的组装缓冲区，自带一个绑定在缓冲区上的ostream
+// 每个线程持有若干个，按嵌套深度复用，因此一条记录在提交之前只属于当前线程
+class MLogBuffer {
+public:
+    MLogBuffer() : m_stream(&m_buf) {}
+
+    MLogBuffer(const MLogBuffer &) = delete;
+    MLogBuffer &operator=(const MLogBuffer &) = delete;
+
+    std::string &str() { return m_buf.str(); }
+
+    std::ostream &stream() { return m_stream; }
+
+    // 清空内容并恢复流的默认格式状态，保留已经分配的容量
+    void clear() {
+        m_buf.str().clear();
+        m_stream.clear();
+        m_stream.flags(std::ios_base::dec | std::ios_base::skipws);
+        m_stream.width(0);
+        m_stream.precision(6);
+        m_stream.fill(' ');
+    }
+
+    // 取出当前线程下一层的缓冲区
+    // 记录的构造和析构严格嵌套，因此按深度做栈式管理即可
+    // 线程局部的缓冲区已经析构时（例如main结束后logger析构时写日志），临时分配一个
+    static MLogBuffer &acquire() {
+        Pool *pool = thread_pool();
+        if (pool == nullptr) {
+            auto *buffer = new MLogBuffer();
+            buffer->m_pooled = false;
+            return *buffer;
+        }
+
+        if (pool->depth == pool->buffers.size()) {
+            pool->buffers.push_back(std::make_unique<MLogBuffer>());
+        }
+        MLogBuffer &buffer = *pool->buffers[pool->depth++];
+        buffer.clear();
+        return buffer;
+    }
+
+    // 归还最近一次取出的缓冲区
+    static void release(MLogBuffer &buffer) {
+        if (!buffer.m_pooled) {
+            delete &buffer;
+            return;
+        }
+        --thread_pool()->depth;
+    }
+
+private:
+    struct Pool {
+        std::vector<std::unique_ptr<MLogBuffer>> buffers;
+        std::size_t depth{0};
+        bool *destroyed{nullptr};
+
+        explicit Pool(bool *destroyed_flag) : destroyed(destroyed_flag) {}
+
+        Pool(const Pool &) = delete;
+        Pool &operator=(const Pool &) = delete;
+
+        ~Pool() { *destroyed = true; }
+    };
+
+    static Pool *thread_pool() {
+        thread_local bool the_pool_destroyed = false;  // 平凡类型，不会被析构
+        if (the_pool_destroyed) return nullptr;
+
+        thread_local Pool the_buffer_pool{&the_pool_destroyed};
+        return &the_buffer_pool;
+    }
+
+    MLogStringBuf m_buf;
+    std::ostream m_stream;
+    bool m_pooled{true};
+};
+
+#endif  // MLOGBUFFER_H_
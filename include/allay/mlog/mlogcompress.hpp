@@ -0,0 +1,441 @@
+#ifndef MLOGCOMPRESS_H_
+#define MLOGCOMPRESS_H_
+
+#include "mlogsink.hpp"
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// 分块压缩的日志格式，使用内置的LZ77压缩（与LZ4的块格式类似），没有外部依赖
+// 文件由若干个相互独立的块组成，每块之前有一个16字节的块头
+//     magic "MLZ1" | 原始长度 u32 | 存储长度 u32 | 原始内容的FNV-1a校验 u32
+// 存储长度等于原始长度时块中是未压缩的原文
+// 每个块都可以单独解码，读取时可以跳过任意多个块，或者从损坏处找到下一个块头继续
+class MLogLz {
+public:
+    MLogLz() = delete;
+
+    constexpr static char magic[4] = {'M', 'L', 'Z', '1'};
+    constexpr static std::size_t header_size = 16;
+    constexpr static std::size_t max_block_size = 1U << 24U;  // 16 MiB
+
+    // 哈希表，压缩时复用以免每块重新分配
+    using HashTable = std::array<std::uint32_t, 1U << 12U>;
+
+    // 压缩src追加到out，返回压缩后的长度
+    // 序列的格式：token(高4位字面量长度，低4位匹配长度-4) [长度扩展] 字面量 偏移u16 [长度扩展]
+    // 最后一个序列只有字面量
+    static std::size_t compress(std::string &out, std::string_view src,
+                                HashTable &table) {
+        const std::size_t start = out.size();
+        table.fill(0);
+
+        const std::size_t n = src.size();
+        const char *data = src.data();
+        std::size_t anchor = 0;  // 尚未输出的字面量的起点
+        std::size_t pos = 0;
+
+        // 末尾至少留出若干字节作为字面量，读取4字节时不会越界
+        const std::size_t limit = n > tail_literals ? n - tail_literals : 0;
+        while (pos < limit) {
+            const std::uint32_t seq = read32(data + pos);
+            const std::size_t slot = hash(seq);
+            const std::size_t candidate = table[slot];
+            table[slot] = static_cast<std::uint32_t>(pos + 1);  // 0表示空
+
+            if (candidate == 0 || pos - (candidate - 1) > max_offset
+                || read32(data + candidate - 1) != seq) {
+                ++pos;
+                continue;
+            }
+
+            const std::size_t match = candidate - 1;
+            std::size_t len = min_match;
+            while (pos + len < limit && data[match + len] == data[pos + len]) {
+                ++len;
+            }
+
+            write_sequence(out, std::string_view{data + anchor, pos - anchor},
+                           pos - match, len);
+            pos += len;
+            anchor = pos;
+        }
+        write_literals(out, std::string_view{data + anchor, n - anchor});
+        return out.size() - start;
+    }
+
+    // 解压src追加到out，raw_size是原始长度，格式错误时返回false
+    static bool decompress(std::string &out, std::string_view src,
+                           std::size_t raw_size) {
+        const std::size_t start = out.size();
+        out.resize(start + raw_size);
+        char *dst = out.data() + start;
+        std::size_t op = 0;
+        std::size_t ip = 0;
+
+        while (ip < src.size()) {
+            const auto token = static_cast<std::uint8_t>(src[ip++]);
+
+            std::size_t literal_len = token >> 4U;
+            if (literal_len == 15 && !read_length(src, ip, literal_len)) {
+                return false;
+            }
+            if (literal_len > src.size() - ip || literal_len > raw_size - op) {
+                return false;
+            }
+            std::memcpy(dst + op, src.data() + ip, literal_len);
+            ip += literal_len;
+            op += literal_len;
+            if (ip == src.size()) break;  // 最后一个序列
+
+            if (src.size() - ip < 2) return false;
+            const std::size_t offset =
+                static_cast<std::uint8_t>(src[ip])
+                | (static_cast<std::size_t>(static_cast<std::uint8_t>(src[ip + 1]))
+                   << 8U);
+            ip += 2;
+
+            std::size_t match_len = token & 0xFU;
+            if (match_len == 15 && !read_length(src, ip, match_len)) {
+                return false;
+            }
+            match_len += min_match;
+            if (offset == 0 || offset > op || match_len > raw_size - op) {
+                return false;
+            }
+            // 匹配可能与输出重叠，逐字节复制
+            for (std::size_t i = 0; i < match_len; ++i, ++op) {
+                dst[op] = dst[op - offset];
+            }
+        }
+
+        if (op != raw_size) {
+            out.resize(start);
+            return false;
+        }
+        return true;
+    }
+
+    static std::uint32_t checksum(std::string_view data) {
+        std::uint32_t result = 2166136261U;
+        for (const char ch : data) {
+            result = (result ^ static_cast<std::uint8_t>(ch)) * 16777619U;
+        }
+        return result;
+    }
+
+    // 压缩一个完整的块（块头和内容）追加到out，压缩没有效果时存储原文
+    static void encode_block(std::string &out, std::string_view raw,
+                             HashTable &table) {
+        const std::size_t start = out.size();
+        out.append(static_cast<const char *>(magic), sizeof(magic));
+        out.append(header_size - sizeof(magic), '\0');
+
+        std::size_t stored = compress(out, raw, table);
+        if (stored >= raw.size()) {
+            out.resize(start + header_size);
+            out.append(raw);
+            stored = raw.size();
+        }
+
+        char *header = out.data() + start + sizeof(magic);
+        put(header, static_cast<std::uint32_t>(raw.size()));
+        put(header + 4, static_cast<std::uint32_t>(stored));
+        put(header + 8, checksum(raw));
+    }
+
+    // 依次解码每一块并写出原文，遇到损坏的块时跳到下一个块头继续
+    // 跳过前skip_blocks块（只读取块头，不解压）
+    // 文件完整时返回true，有损坏或者末尾的块不完整时返回false
+    static bool decode(std::istream &in, std::ostream &out,
+                       std::size_t skip_blocks = 0) {
+        bool ok = true;
+        std::string stored;
+        std::string raw;
+        char header[header_size];
+        std::size_t block = 0;
+
+        while (in.read(static_cast<char *>(header), header_size)) {
+            const std::uint32_t raw_size = get(header + 4);
+            const std::uint32_t stored_size = get(header + 8);
+            const std::uint32_t sum = get(header + 12);
+
+            if (std::memcmp(header, magic, sizeof(magic)) != 0
+                || raw_size > max_block_size || stored_size > raw_size) {
+                ok = false;
+                if (!resync(in, header)) return false;
+                continue;
+            }
+
+            if (block++ < skip_blocks) {
+                in.seekg(stored_size, std::ios_base::cur);
+                continue;
+            }
+
+            stored.resize(stored_size);
+            if (!in.read(stored.data(), stored_size)) return false;
+
+            raw.clear();
+            bool decoded = true;
+            if (stored_size == raw_size) { raw.append(stored); }
+            else { decoded = decompress(raw, stored, raw_size); }
+            if (!decoded || checksum(raw) != sum) {
+                ok = false;
+                continue;
+            }
+            out.write(raw.data(), static_cast<std::streamsize>(raw.size()));
+        }
+        // 只读取了半个块头
+        return ok && in.gcount() == 0;
+    }
+
+private:
+    constexpr static std::size_t min_match = 4;
+    constexpr static std::size_t max_offset = 65535;
+    constexpr static std::size_t tail_literals = 8;
+
+    static std::uint32_t read32(const char *ptr) {
+        std::uint32_t value = 0;
+        std::memcpy(&value, ptr, sizeof(value));
+        return value;
+    }
+
+    static std::size_t hash(std::uint32_t seq) {
+        return (seq * 2654435761U) >> 20U;
+    }
+
+    static void put(char *dst, std::uint32_t value) {
+        std::memcpy(dst, &value, sizeof(value));
+    }
+
+    static std::uint32_t get(const char *src) {
+        std::uint32_t value = 0;
+        std::memcpy(&value, src, sizeof(value));
+        return value;
+    }
+
+    // 长度超过14时，之后的字节依次累加，直到一个小于255的字节
+    static void write_length(std::string &out, std::size_t len) {
+        for (; len >= 255; len -= 255) out.push_back(static_cast<char>(255));
+        out.push_back(static_cast<char>(len));
+    }
+
+    static bool read_length(std::string_view src, std::size_t &ip,
+                            std::size_t &len) {
+        for (;;) {
+            if (ip == src.size()) return false;
+            const auto byte = static_cast<std::uint8_t>(src[ip++]);
+            len += byte;
+            if (byte != 255) return true;
+        }
+    }
+
+    static void write_sequence(std::string &out, std::string_view literals,
+                               std::size_t offset, std::size_t match_len) {
+        const std::size_t literal_len = literals.size();
+        const std::size_t match_code = match_len - min_match;
+        out.push_back(static_cast<char>(
+            (std::min<std::size_t>(literal_len, 15) << 4U)
+            | std::min<std::size_t>(match_code, 15)));
+        if (literal_len >= 15) write_length(out, literal_len - 15);
+        out.append(literals);
+        out.push_back(static_cast<char>(offset & 0xFFU));
+        out.push_back(static_cast<char>(offset >> 8U));
+        if (match_code >= 15) write_length(out, match_code - 15);
+    }
+
+    static void write_literals(std::string &out, std::string_view literals) {
+        const std::size_t literal_len = literals.size();
+        out.push_back(
+            static_cast<char>(std::min<std::size_t>(literal_len, 15) << 4U));
+        if (literal_len >= 15) write_length(out, literal_len - 15);
+        out.append(literals);
+    }
+
+    // 块头损坏时逐字节向后寻找下一个magic，header中保存已经读取的16字节
+    static bool resync(std::istream &in, char *header) {
+        std::size_t have = header_size;
+        for (;;) {
+            std::memmove(header, header + 1, have - 1);
+            --have;
+            if (have < sizeof(magic)) {
+                char ch = 0;
+                if (!in.get(ch)) return false;
+                header[have++] = ch;
+            }
+            if (std::memcmp(header, magic, sizeof(magic)) == 0) break;
+        }
+        // 把找到的块头之后的字节退回
+        in.clear();
+        in.seekg(-static_cast<std::streamoff>(have), std::ios_base::cur);
+        return static_cast<bool>(in);
+    }
+};
+
+// 分块压缩的日志文件，格式见MLogLz
+// 记录先追加到当前块，块满block_size字节时交给后台线程压缩并写入文件，写日志的线程不做压缩
+// 放不下的记录从下一块开始，超过block_size的记录被切分到多个块中，每块都不超过block_size
+// 记录的std::endl不会立即写出（否则块会很小），只有flush()才会封存当前块并等待写出
+// MLogger::flush会冲刷它的所有sink；析构时写出剩余的内容
+// 读取使用MLogLz::decode或者mlog_cat
+class MLogCompressedSink : public MLogSink {
+public:
+    constexpr static std::size_t default_block_size = 64U << 10U;  // 64 KiB
+    constexpr static std::size_t max_pending_blocks = 8;
+
+    explicit MLogCompressedSink(const std::string &file_name,
+                                std::size_t block_size = default_block_size,
+                                bool truncate = false)
+        : m_file_name(file_name),
+          m_block_size(std::min(std::max<std::size_t>(block_size, 1),
+                                MLogLz::max_block_size)) {
+        auto ofstream = MLogFileManager::get_unique_ofstream(m_file_name);
+        if (ofstream == nullptr) return;
+
+        ofstream->open(MLogFileManager::get_path_prefix() + m_file_name,
+                       std::ios_base::out | std::ios_base::binary // NOLINT(hicpp-signed-bitwise)
+                           | (truncate ? std::ios_base::trunc
+                                       : std::ios_base::app));
+        if (ofstream->fail()) {
+            MLogFileManager::erase_unique_ofstream(m_file_name);
+            return;
+        }
+        m_ofstream = std::move(ofstream);
+        m_block.reserve(m_block_size);
+        m_worker = std::thread([this]() { worker_loop(); });
+    }
+
+    ~MLogCompressedSink() override {
+        if (m_ofstream == nullptr) return;
+
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        m_worker.join();
+
+        m_ofstream->close();
+        MLogFileManager::erase_unique_ofstream(m_file_name);
+    }
+
+    // 文件名重复或者打开失败时返回false，此时所有记录都被丢弃
+    bool is_open() const { return m_ofstream != nullptr; }
+
+    void write(const MLogRecordView &record) override {
+        if (m_ofstream == nullptr) return;
+
+        std::string_view text = payload(record);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_block.empty() && m_block.size() + text.size() > m_block_size) {
+            seal(lock);
+        }
+        while (m_block.size() + text.size() > m_block_size) {
+            const std::size_t room = m_block_size - m_block.size();
+            m_block.append(text.substr(0, room));
+            text.remove_prefix(room);
+            seal(lock);
+        }
+        m_block.append(text);
+        if (m_block.size() >= m_block_size) seal(lock);
+    }
+
+    // 封存当前块，等待所有块写入文件
+    void flush() override {
+        if (m_ofstream == nullptr) return;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_block.empty()) seal(lock);
+        const std::uint64_t target = m_sealed;
+        m_cond.wait(lock, [this, target]() { return m_written >= target; });
+    }
+
+    // 写入的原文和压缩后的字节数（含块头），只统计已经写入文件的块
+    std::uint64_t raw_bytes() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_raw_bytes;
+    }
+
+    std::uint64_t stored_bytes() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stored_bytes;
+    }
+
+private:
+    // 把当前块交给后台线程，待处理的块太多时等待，限制内存占用
+    // 换回一个已经写出的块的缓冲区，稳定之后不再分配
+    void seal(std::unique_lock<std::mutex> &lock) {
+        m_cond.wait(lock,
+                    [this]() { return m_pending.size() < max_pending_blocks; });
+        std::string next;
+        if (!m_free.empty()) {
+            next = std::move(m_free.back());
+            m_free.pop_back();
+        }
+        next.clear();
+        m_pending.push_back(std::move(m_block));
+        m_block = std::move(next);
+        ++m_sealed;
+        m_cond.notify_all();
+    }
+
+    void worker_loop() {
+        MLogLz::HashTable table{};
+        std::string out;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            m_cond.wait(lock, [this]() { return m_stop || !m_pending.empty(); });
+            if (m_pending.empty()) return;
+
+            std::string raw = std::move(m_pending.front());
+            m_pending.pop_front();
+            lock.unlock();
+
+            // 压缩和写文件不持有锁，写日志的线程只在交接时等待
+            out.clear();
+            MLogLz::encode_block(out, raw, table);
+            m_ofstream->write(out.data(),
+                              static_cast<std::streamsize>(out.size()));
+            m_ofstream->flush();
+
+            lock.lock();
+            m_raw_bytes += raw.size();
+            m_stored_bytes += out.size();
+            m_free.push_back(std::move(raw));
+            ++m_written;
+            m_cond.notify_all();
+        }
+    }
+
+    std::string m_file_name;
+    const std::size_t m_block_size;
+    std::shared_ptr<std::ofstream> m_ofstream;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::string m_block;                // 当前正在追加的块
+    std::deque<std::string> m_pending;  // 等待压缩的块
+    std::deque<std::string> m_free;     // 可以复用的缓冲区
+    std::uint64_t m_sealed{0};          // 已经封存的块数
+    std::uint64_t m_written{0};         // 已经写入文件的块数
+    std::uint64_t m_raw_bytes{0};
+    std::uint64_t m_stored_bytes{0};
+    bool m_stop{false};
+    std::thread m_worker;
+};
+
+#endif  // MLOGCOMPRESS_H_
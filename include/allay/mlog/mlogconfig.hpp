@@ -0,0 +1,381 @@
+#ifndef MLOGCONFIG_H_
+#define MLOGCONFIG_H_
+
+#include "../ini_parser/ini_parser.hpp"
+
+#include "mloggermanager.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#define MLOG_HAS_INOTIFY
+#endif
+
+#ifdef MLOG_HAS_INOTIFY
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <chrono>
+#include <condition_variable>
+#endif
+
+// 从INI文件读取logger的设置，并在后台线程中监视文件的修改，例如
+//
+//   level = info              # 全局等级
+//   [net]
+//   level = debug             # 这个logger的等级，global表示使用全局等级
+//   format = level_signature  # LogStartFormat的小写名称
+//   out = file                # cout、file、cout_file或者none
+//   file = net.log            # 不含路径前缀，以追加方式打开
+//
+// 第一次读取时应用全部设置，之后文件每次修改只重新应用等级
+// 等级是原子变量，写日志的线程不加锁就能看到新的等级；格式和输出不能在写日志的同时修改，需要重新启动
+// 只修改已经存在的logger，之后创建的logger在下一次修改文件时得到它的等级
+// 从文件中删除的等级恢复为全局等级；文件中有任何错误时整个文件被忽略，保持原来的设置
+// 日志文件已经被其它logger使用或者无法写入也是错误，不会退出程序
+// Linux上通过inotify监视所在的目录（编辑器通常会替换整个文件），其它平台每秒检查一次修改时间
+class MLogConfig {
+public:
+    using Level = MLogTool::Level;
+    using Format = MLogTool::LogStartFormat;
+    using Out = MLogTool::OutType;
+
+    MLogConfig(const MLogConfig &) = delete;
+    MLogConfig &operator=(const MLogConfig &) = delete;
+
+    // 读取并应用全部设置，在其它线程开始写日志之前调用
+    static bool load(const std::string &path) {
+        auto &inst = get_instance();
+        std::lock_guard<std::mutex> lock(inst.m_mutex);
+        return inst.apply(path, true);
+    }
+
+    // 读取并应用全部设置，然后在后台线程中监视文件，读取失败时不会开始监视
+    // 再次调用时改为监视新的文件
+    static bool watch(const std::string &path) {
+        stop();
+        if (!load(path)) return false;
+        return get_instance().start(path);
+    }
+
+    // 停止监视，已经应用的设置保持不变
+    static void stop() { get_instance().stop_thread(); }
+
+    // 后台线程成功重新加载的次数
+    static std::size_t reload_count() {
+        return get_instance().m_reload_count.load(std::memory_order_acquire);
+    }
+
+    static MLogConfig &get_instance() {
+        static MLogConfig the_config;
+        return the_config;
+    }
+
+private:
+    // 一个logger的设置，inherit表示使用全局等级
+    struct Setting {
+        std::optional<Level> level;
+        bool inherit{false};
+        std::optional<Format> format;
+        std::optional<Out> out;
+        std::string file;
+    };
+
+    MLogConfig() = default;
+
+    ~MLogConfig() { stop_thread(); }
+
+    static std::string to_lower(std::string str) {
+        std::ranges::transform(str, str.begin(), [](unsigned char ch) {
+            return static_cast<char>(std::tolower(ch));
+        });
+        return str;
+    }
+
+    static std::optional<Level> parse_level(const std::string &value) {
+        static const std::map<std::string, Level> the_levels{
+            {"on", Level::on},     {"debug", Level::debug},
+            {"info", Level::info}, {"warn", Level::warn},
+            {"error", Level::error}, {"off", Level::off}};
+        auto iter = the_levels.find(to_lower(value));
+        if (iter == the_levels.end()) return std::nullopt;
+        return iter->second;
+    }
+
+    static std::optional<Format> parse_format(const std::string &value) {
+        static const std::map<std::string, Format> the_formats{
+            {"level_signature_time", Format::LEVEL_SIGNATURE_TIME},
+            {"level_signature", Format::LEVEL_SIGNATURE},
+            {"level_time", Format::LEVEL_TIME},
+            {"level", Format::LEVEL},
+            {"level_color", Format::LEVEL_COLOR},
+            {"none", Format::NONE}};
+        auto iter = the_formats.find(to_lower(value));
+        if (iter == the_formats.end()) return std::nullopt;
+        return iter->second;
+    }
+
+    static std::optional<Out> parse_out(const std::string &value) {
+        static const std::map<std::string, Out> the_outs{
+            {"cout", Out::C},
+            {"file", Out::F},
+            {"cout_file", Out::CF},
+            {"none", Out::N}};
+        auto iter = the_outs.find(to_lower(value));
+        if (iter == the_outs.end()) return std::nullopt;
+        return iter->second;
+    }
+
+    // 解析一个logger的设置，有任何错误时返回false
+    static bool parse_setting(const std::map<std::string, std::string> &pairs,
+                              Setting &setting) {
+        for (const auto &[key, value] : pairs) {
+            if (key == "level") {
+                setting.inherit = (to_lower(value) == "global");
+                setting.level = parse_level(value);
+                if (!setting.inherit && !setting.level) return false;
+            }
+            else if (key == "format") {
+                setting.format = parse_format(value);
+                if (!setting.format) return false;
+            }
+            else if (key == "out") {
+                setting.out = parse_out(value);
+                if (!setting.out) return false;
+            }
+            else if (key == "file") {
+                if (!MLogTool::check_filename_valid(value)) return false;
+                setting.file = value;
+            }
+            else { return false; }
+        }
+
+        const bool need_file = setting.out == Out::F || setting.out == Out::CF;
+        return !need_file || !setting.file.empty();
+    }
+
+    // 先解析整个文件，全部正确之后才修改设置
+    // full为false时只修改等级，不会修改文件流，可以和写日志同时进行
+    bool apply(const std::string &path, bool full) {
+        IniParser ini;
+        try {
+            ini.read(path);
+        }
+        catch (const std::exception &) {
+            return false;
+        }
+
+        std::optional<Level> global_level;
+        std::map<std::string, Setting> settings;
+        for (const auto &[section, pairs] : ini.export_all()) {
+            if (section.empty()) {
+                for (const auto &[key, value] : pairs) {
+                    global_level = parse_level(value);
+                    if (key != "level" || !global_level) return false;
+                }
+                continue;
+            }
+            if (!parse_setting(pairs, settings[section])) return false;
+        }
+
+        if (full && !check_outputs(settings)) return false;
+
+        if (global_level) MLogTool::set_level(*global_level);
+
+        std::vector<std::string> leveled;
+        for (const auto &[name, setting] : settings) {
+            MLogger *logger = MLoggerManager::find_logger(name);
+            if (logger == nullptr) continue;
+
+            if (full && !apply_output(*logger, setting)) return false;
+
+            if (setting.inherit) { logger->reset_level(); }
+            else if (setting.level) { logger->set_level(*setting.level); }
+            if (setting.inherit || setting.level) leveled.push_back(name);
+        }
+
+        // 上一次由这个文件设置、这一次不再出现的等级恢复为全局等级
+        for (const std::string &name : m_leveled) {
+            if (std::ranges::find(leveled, name) != leveled.end()) continue;
+            if (MLogger *logger = MLoggerManager::find_logger(name)) {
+                logger->reset_level();
+            }
+        }
+        m_leveled = std::move(leveled);
+        return true;
+    }
+
+    // 修改任何设置之前检查所有的日志文件：没有被其它logger占用、不会被两个logger同时使用，并且可以写入
+    static bool check_outputs(const std::map<std::string, Setting> &settings) {
+        std::vector<std::string> files;
+        for (const auto &[name, setting] : settings) {
+            if (setting.out != Out::F && setting.out != Out::CF) continue;
+
+            MLogger *logger = MLoggerManager::find_logger(name);
+            if (logger == nullptr || logger->is_locked()) continue;
+
+            std::string file = to_lower(setting.file);
+            if (std::ranges::find(files, file) != files.end()
+                || !logger->can_link_file(setting.file)) {
+                return false;
+            }
+            files.push_back(std::move(file));
+        }
+        return true;
+    }
+
+    // 锁定的logger（例如cout）不改变输出，打开文件失败时返回false
+    static bool apply_output(MLogger &logger, const Setting &setting) {
+        if (setting.format) logger.set_format(*setting.format);
+        if (!setting.out || logger.is_locked()) return true;
+
+        switch (*setting.out) {
+        case Out::C: logger.link_cout(); break;
+        case Out::N: logger.link_none(); break;
+        case Out::F: return logger.try_link_file_app(setting.file);
+        case Out::CF:
+            if (!logger.try_link_file_app(setting.file)) return false;
+            logger.enable_file_and_cout();
+            break;
+        }
+        return true;
+    }
+
+    // 后台线程发现文件被修改
+    void on_change(const std::string &path) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (apply(path, false)) {
+            m_reload_count.fetch_add(1, std::memory_order_release);
+            return;
+        }
+        MLoggerManager::get_logger_when(Level::warn)
+            << " Can not reload the log config \"" << path
+            << "\", keep the current settings.\n";
+    }
+
+#ifdef MLOG_HAS_INOTIFY
+    bool start(const std::string &path) {
+        namespace fs = std::filesystem;
+        const fs::path file_path{path};
+        const std::string dir =
+            file_path.has_parent_path() ? file_path.parent_path().string() : ".";
+        const std::string name = file_path.filename().string();
+
+        if (::pipe2(static_cast<int *>(m_wake), O_CLOEXEC) != 0) return false;
+        m_inotify = ::inotify_init1(IN_CLOEXEC);
+        if (m_inotify < 0
+            || ::inotify_add_watch(m_inotify, dir.c_str(),
+                                   IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            close_fds();
+            return false;
+        }
+
+        m_thread = std::thread([this, path, name]() { watch_loop(path, name); });
+        return true;
+    }
+
+    void watch_loop(const std::string &path, const std::string &name) {
+        alignas(inotify_event) char buffer[4096];
+        for (;;) {
+            pollfd fds[2]{{m_inotify, POLLIN, 0}, {m_wake[0], POLLIN, 0}};
+            if (::poll(static_cast<pollfd *>(fds), 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            if (fds[1].revents != 0) return;
+
+            const ::ssize_t n = ::read(m_inotify, static_cast<char *>(buffer),
+                                       sizeof(buffer));
+            if (n <= 0) continue;
+
+            // 同一次保存可能产生多个事件，只重新加载一次
+            bool changed = false;
+            for (::ssize_t pos = 0; pos < n;) {
+                inotify_event event{};
+                std::memcpy(&event, static_cast<char *>(buffer) + pos,
+                            sizeof(event));
+                const char *event_name =
+                    static_cast<char *>(buffer) + pos
+                    + static_cast<::ssize_t>(sizeof(inotify_event));
+                if (event.len > 0 && name == event_name) changed = true;
+                pos += static_cast<::ssize_t>(sizeof(inotify_event) + event.len);
+            }
+            if (changed) on_change(path);
+        }
+    }
+
+    void stop_thread() {
+        if (m_thread.joinable()) {
+            const char ch = 0;
+            static_cast<void>(::write(m_wake[1], &ch, 1));
+            m_thread.join();
+        }
+        close_fds();
+    }
+
+    void close_fds() {
+        for (int *fd : {&m_inotify, &m_wake[0], &m_wake[1]}) {
+            if (*fd >= 0) ::close(*fd);
+            *fd = -1;
+        }
+    }
+
+    int m_inotify{-1};
+    int m_wake[2]{-1, -1};  // 写入一个字节唤醒后台线程并结束
+#else
+    bool start(const std::string &path) {
+        m_stop = false;
+        m_thread = std::thread([this, path]() { watch_loop(path); });
+        return true;
+    }
+
+    void watch_loop(const std::string &path) {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        auto last = fs::last_write_time(path, ec);
+
+        std::unique_lock<std::mutex> lock(m_stop_mutex);
+        while (!m_stop_cv.wait_for(lock, std::chrono::seconds(1),
+                                   [this]() { return m_stop; })) {
+            const auto now = fs::last_write_time(path, ec);
+            if (ec || now == last) continue;
+            last = now;
+            on_change(path);
+        }
+    }
+
+    void stop_thread() {
+        {
+            std::lock_guard<std::mutex> lock(m_stop_mutex);
+            m_stop = true;
+        }
+        m_stop_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    std::mutex m_stop_mutex;
+    std::condition_variable m_stop_cv;
+    bool m_stop{false};
+#endif
+
+    std::mutex m_mutex;  // 保护下面的状态，load和后台线程不会同时应用设置
+    std::vector<std::string> m_leveled;  // 上一次由文件设置了等级的logger
+    std::atomic<std::size_t> m_reload_count{0};
+    std::thread m_thread;
+};
+
+#endif  // MLOGCONFIG_H_
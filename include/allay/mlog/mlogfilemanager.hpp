@@ -4,19 +4,156 @@
 #include "mlogtool.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
 
 // 最底层的文件层，一个文件名提供一个ofstream
 // 必须被一个logger独占，通过map来管理，但是不负责文件打开关闭的细节
+// 滚动日志文件的重命名和删除也在这里，由一个后台线程完成
 class MLogFileManager {
 public:
-    friend class MLogger;  // 所有的接口只可以被logger调用
+    friend class MLogger;  // 所有的接口只可以被logger和文件sink调用
+    friend class MLogFileSink;
+    friend class MLogCompressedSink;
+
+    // 按时间滚动的边界，使用本地时间
+    enum class RotateInterval {
+        NONE = 0,  // 不按时间滚动
+        HOURLY,    // 每个整点
+        DAILY,     // 每天零点
+    };
+
+    // 滚动策略，max_size和interval满足其一就切换到新的文件
+    struct RotatePolicy {
+        std::uintmax_t max_size{0};  // 单个文件的字节数上限，0表示不按大小滚动
+        RotateInterval interval{RotateInterval::NONE};
+        std::size_t max_files{0};  // 保留的旧文件个数，0表示全部保留
+    };
+
+    // 文件流的冲刷策略，满足任意一个条件就冲刷，默认只在std::endl或者std::flush时冲刷
+    // 全部关闭表示从不主动冲刷，只在缓冲区写满或者关闭文件时写出
+    // 例如 {.every_records = 1000, .interval = 200ms, .level = Level::warn}
+    struct FlushPolicy {
+        std::size_t every_records{0};  // 每N条记录冲刷一次，0表示不按条数
+        // 写入记录时距离上次冲刷（或者打开文件、设置策略）超过T则冲刷，0表示不按时间
+        // 只在写入记录时判断，没有后台定时器：安静下来的logger的缓冲区
+        // 会保留到下一条记录、flush()或者关闭文件，需要及时落盘的记录通过level触发
+        std::chrono::milliseconds interval{0};
+        MLogTool::Level level{MLogTool::Level::off};  // 不低于该等级的记录立即冲刷
+        bool on_endl{true};  // std::endl和std::flush是否冲刷文件
+        // 文件流的用户空间缓冲区字节数，0表示使用标准库默认的大小
+        // 缓冲区写满时一次系统调用整体写出，在下一次打开文件时生效
+        std::size_t buffer_size{0};
+    };
 
     MLogFileManager &operator=(const MLogFileManager &) = delete;
     MLogFileManager(const MLogFileManager &) = delete;
 
+    // 一个滚动文件的状态，由持有文件流的一方负责加锁
+    // 文件名不含路径前缀
+    class Rotator {
+    public:
+        // 开始滚动，记录当前文件的大小和下一个滚动时刻，并按照保留个数清理一次旧文件
+        void start(const std::string &file_name, const RotatePolicy &policy) {
+            std::error_code ec;
+            const auto size = std::filesystem::file_size(
+                get_instance().m_path_prefix + file_name, ec);
+
+            m_file_name = file_name;
+            m_policy = policy;
+            m_enabled = (policy.max_size > 0
+                         || policy.interval != RotateInterval::NONE);
+            m_file_size = ec ? 0 : size;
+            m_rotate_time = next_rotate_time(std::time(nullptr), policy.interval);
+
+            if (m_enabled) {
+                submit_rotate(m_file_name, std::string{}, m_policy.max_files);
+            }
+        }
+
+        // 停止滚动，并等待后台线程把文件改回正确的名字
+        void stop() {
+            if (m_enabled) wait_rotate();
+            m_enabled = false;
+        }
+
+        bool enabled() const { return m_enabled; }
+
+        // 记录写入的字节数，需要滚动时返回true
+        bool add(std::size_t bytes) {
+            if (!m_enabled) return false;
+
+            m_file_size += bytes;
+            return (m_policy.max_size > 0 && m_file_size >= m_policy.max_size)
+                   || std::time(nullptr) >= m_rotate_time;
+        }
+
+        // 把文件流切换到新的文件，这里只关闭和打开文件，重命名交给后台线程
+        // 新文件打开失败时继续写原来的文件，并且不再滚动
+        bool rotate(std::ofstream &stream) {
+#if defined(_WIN32)
+            // Windows上不能重命名打开着的文件，在写入的一方关闭文件，等待之前的任务完成，
+            // 把它改名为下一个编号之后重新打开同名的新文件，后台线程只负责删除多余的旧文件
+            const std::string file_path = get_instance().m_path_prefix + m_file_name;
+            stream.close();
+            wait_rotate();
+            const bool renamed = rename_to_next(file_path);
+            stream.open(file_path, std::ios_base::out // NOLINT(hicpp-signed-bitwise)
+                                       | (renamed ? std::ios_base::trunc
+                                                  : std::ios_base::app));
+            if (!renamed || stream.fail()) {
+                if (stream.fail()) {
+                    stream.clear();
+                    stream.open(file_path, std::ios_base::out | std::ios_base::app); // NOLINT(hicpp-signed-bitwise)
+                }
+                m_enabled = false;
+                return false;
+            }
+            submit_rotate(m_file_name, std::string{}, m_policy.max_files);
+#else
+            const std::string segment_name = rotate_segment_name(m_file_name);
+
+            stream.close();
+            stream.open(segment_name, std::ios_base::out | std::ios_base::trunc); // NOLINT(hicpp-signed-bitwise)
+            if (stream.fail()) {
+                stream.clear();
+                stream.open(get_instance().m_path_prefix + m_file_name,
+                            std::ios_base::out | std::ios_base::app); // NOLINT(hicpp-signed-bitwise)
+                m_enabled = false;
+                return false;
+            }
+
+            submit_rotate(m_file_name, segment_name, m_policy.max_files);
+#endif
+            m_file_size = 0;
+            m_rotate_time =
+                next_rotate_time(std::time(nullptr), m_policy.interval);
+            return true;
+        }
+
+    private:
+        std::string m_file_name;
+        RotatePolicy m_policy;
+        bool m_enabled{false};
+        std::uintmax_t m_file_size{0};  // 当前文件已经写入的字节数
+        std::time_t m_rotate_time{0};   // 下一个按时间滚动的时刻
+    };
+
     static void set_path_prefix(const std::string &path_prefix) {
         get_instance().m_path_prefix = path_prefix;
     }
@@ -40,19 +177,24 @@ private:
         // 存储的map使用的是全小写
         std::string file_name = to_low(raw_file_name);
 
-        // 如果已经存在，不会给新的用户
-        if (get_instance().m_ofstream_map.find(file_name)
-            != get_instance().m_ofstream_map.end())
-            return nullptr;
-
         // 名称不合法也不分配
         if (file_name.empty() || !MLogTool::check_filename_valid(file_name))
             return nullptr;
 
-        // 分配并存储新的日志文件流
-        get_instance().m_ofstream_map[file_name] =
-            std::make_shared<std::ofstream>();
-        return get_instance().m_ofstream_map[file_name];
+        // 如果已经存在，不会给新的用户，否则分配并存储新的日志文件流
+        std::lock_guard<std::mutex> lock(get_instance().m_ofstream_mutex);
+        auto [iter, inserted] =
+            get_instance().m_ofstream_map.try_emplace(file_name);
+        if (!inserted) return nullptr;
+
+        iter->second = std::make_shared<std::ofstream>();
+        return iter->second;
+    }
+
+    // 文件名是否已经被某个logger占用
+    static bool is_used(const std::string &raw_file_name) {
+        std::lock_guard<std::mutex> lock(get_instance().m_ofstream_mutex);
+        return get_instance().m_ofstream_map.contains(to_low(raw_file_name));
     }
 
     // 负责erase，但是不负责文件关闭
@@ -60,21 +202,207 @@ private:
         // 存储的map使用的是全小写
         std::string file_name = to_low(raw_file_name);
 
+        std::lock_guard<std::mutex> lock(get_instance().m_ofstream_mutex);
         if (auto iter = get_instance().m_ofstream_map.find(file_name);
             iter != get_instance().m_ofstream_map.end())
             get_instance().m_ofstream_map.erase(iter);
     }
 
+    //----------------------------------------------------------------------------//
+    // 滚动日志文件
+    // 当前文件总是名为file_name，旧文件依次命名为file_name.1、file_name.2...，编号越大越新
+    // 滚动时logger只打开一个临时名称的新文件并切换过去，不做任何重命名
+    // 后台线程随后把file_name改名为下一个编号，把临时文件改名为file_name，再删除多余的旧文件
+    // 任务按提交顺序执行，因此即使连续滚动多次，文件名最终也是正确的
+
+    // 下一段日志使用的临时文件名，包含路径前缀
+    static std::string rotate_segment_name(const std::string &file_name) {
+        const auto seq =
+            get_instance().m_rotate_seq.fetch_add(1, std::memory_order_relaxed);
+        return get_instance().m_path_prefix + file_name + ".next."
+               + std::to_string(seq);
+    }
+
+    // 提交一次滚动，segment_name为空时只整理旧文件
+    static void submit_rotate(const std::string &file_name,
+                              const std::string &segment_name,
+                              std::size_t max_files) {
+        auto &inst = get_instance();
+        {
+            std::lock_guard<std::mutex> lock(inst.m_rotate_mutex);
+            inst.m_rotate_jobs.push_back(RotateJob{
+                inst.m_path_prefix + file_name, segment_name, max_files});
+            ++inst.m_rotate_pending;
+            if (!inst.m_rotate_thread.joinable()) {
+                inst.m_rotate_thread = std::thread([&inst]() { inst.rotate_loop(); });
+            }
+        }
+        inst.m_rotate_cv.notify_all();
+    }
+
+    // 等待已经提交的滚动全部完成
+    static void wait_rotate() {
+        auto &inst = get_instance();
+        std::unique_lock<std::mutex> lock(inst.m_rotate_mutex);
+        inst.m_rotate_cv.wait(lock,
+                              [&inst]() { return inst.m_rotate_pending == 0; });
+    }
+
+    // 下一个滚动时刻，不按时间滚动时返回最大值
+    static std::time_t next_rotate_time(std::time_t now,
+                                        RotateInterval interval) {
+        if (interval == RotateInterval::NONE) {
+            return std::numeric_limits<std::time_t>::max();
+        }
+
+        struct tm timeinfo = MLogTool::time_cache(now).timeinfo;
+        timeinfo.tm_min = 0;
+        timeinfo.tm_sec = 0;
+        timeinfo.tm_isdst = -1;
+        if (interval == RotateInterval::HOURLY) { timeinfo.tm_hour += 1; }
+        else {
+            timeinfo.tm_hour = 0;
+            timeinfo.tm_mday += 1;
+        }
+        return std::mktime(&timeinfo);
+    }
+
+    struct RotateJob {
+        std::string file_name;     // 当前文件，包含路径前缀
+        std::string segment_name;  // 已经在使用的新文件
+        std::size_t max_files{0};
+    };
+
+    // 后台线程，析构时处理完剩余的任务再退出
+    void rotate_loop() {
+        std::unique_lock<std::mutex> lock(m_rotate_mutex);
+        for (;;) {
+            m_rotate_cv.wait(lock, [this]() {
+                return !m_rotate_jobs.empty() || m_rotate_stop;
+            });
+            if (m_rotate_jobs.empty()) return;
+
+            RotateJob job = std::move(m_rotate_jobs.front());
+            m_rotate_jobs.pop_front();
+
+            lock.unlock();
+            rotate(job);
+            lock.lock();
+
+            --m_rotate_pending;
+            m_rotate_cv.notify_all();
+        }
+    }
+
+    // 重命名或者删除失败时报告到std::cerr，不影响写日志
+    static void report_error(const char *action, const std::string &path,
+                             const std::error_code &ec) {
+        std::cerr << "MLog: can not " << action << " \"" << path
+                  << "\": " << ec.message() << '\n';
+    }
+
+    // file_name（包含路径前缀）已有的旧文件编号，从小到大
+    static std::vector<std::uint64_t> rotated_indexes(const std::string &file_name) {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+
+        const fs::path path{file_name};
+        const std::string prefix = path.filename().string() + ".";
+        fs::path dir = path.parent_path();
+        if (dir.empty()) dir = ".";
+
+        std::vector<std::uint64_t> indexes;
+        for (fs::directory_iterator iter{dir, ec}, end; !ec && iter != end;
+             iter.increment(ec)) {
+            const std::string name = iter->path().filename().string();
+            if (name.size() <= prefix.size() || name.rfind(prefix, 0) != 0) {
+                continue;
+            }
+            const std::string suffix = name.substr(prefix.size());
+            if (!std::ranges::all_of(suffix, [](char ch) {
+                    return ch >= '0' && ch <= '9';
+                })) {
+                continue;
+            }
+            indexes.push_back(std::stoull(suffix));
+        }
+        std::ranges::sort(indexes);
+        return indexes;
+    }
+
+    // 把file_name改名为下一个编号，文件不存在时什么也不做
+    static bool rename_to_next(const std::string &file_name,
+                               std::vector<std::uint64_t> &indexes) {
+        std::error_code ec;
+        if (!std::filesystem::exists(file_name, ec)) return true;
+
+        const std::uint64_t next = indexes.empty() ? 1 : indexes.back() + 1;
+        const std::string target = file_name + "." + std::to_string(next);
+        std::filesystem::rename(file_name, target, ec);
+        if (ec) {
+            report_error("rename", file_name, ec);
+            return false;
+        }
+        indexes.push_back(next);
+        return true;
+    }
+
+    static bool rename_to_next(const std::string &file_name) {
+        std::vector<std::uint64_t> indexes = rotated_indexes(file_name);
+        return rename_to_next(file_name, indexes);
+    }
+
+    // 当前文件改名失败时不能再把新文件改名过去，否则会覆盖它
+    // 此时logger继续写临时名称的文件，直到下一次滚动
+    static void rotate(const RotateJob &job) {
+        std::error_code ec;
+        std::vector<std::uint64_t> indexes = rotated_indexes(job.file_name);
+
+        if (!job.segment_name.empty() && rename_to_next(job.file_name, indexes)) {
+            std::filesystem::rename(job.segment_name, job.file_name, ec);
+            if (ec) report_error("rename", job.segment_name, ec);
+        }
+
+        // 删除多余的旧文件，编号小的更旧
+        if (job.max_files > 0 && indexes.size() > job.max_files) {
+            const std::size_t extra = indexes.size() - job.max_files;
+            for (std::size_t i = 0; i < extra; ++i) {
+                const std::string old_file =
+                    job.file_name + "." + std::to_string(indexes[i]);
+                std::filesystem::remove(old_file, ec);
+                if (ec) report_error("remove", old_file, ec);
+            }
+        }
+    }
+
     static MLogFileManager &get_instance() {
         static MLogFileManager the_logfile_manager;
         return the_logfile_manager;
     }
 
     MLogFileManager() = default;
-    ~MLogFileManager() = default;
 
+    ~MLogFileManager() {
+        {
+            std::lock_guard<std::mutex> lock(m_rotate_mutex);
+            m_rotate_stop = true;
+        }
+        m_rotate_cv.notify_all();
+        if (m_rotate_thread.joinable()) m_rotate_thread.join();
+    }
+
+    // logger和文件sink可以在不同的线程中打开和关闭文件，因此文件名的登记需要加锁
+    std::mutex m_ofstream_mutex;
     std::map<const std::string, std::shared_ptr<std::ofstream>> m_ofstream_map;
     std::string m_path_prefix;  // 路径前缀，注意路径全部采用/分隔符
+
+    std::atomic<std::uint64_t> m_rotate_seq{0};  // 临时文件名的序号
+    std::mutex m_rotate_mutex;                    // 保护下面的滚动任务队列
+    std::condition_variable m_rotate_cv;
+    std::deque<RotateJob> m_rotate_jobs;
+    std::size_t m_rotate_pending{0};  // 已提交但还没有完成的任务数
+    bool m_rotate_stop{false};
+    std::thread m_rotate_thread;
 };
 
 #endif  // MLOGFILEMANAGER_H_
@@ -3,11 +3,35 @@
 
 #include "mlogtool.hpp"
 
+#include "mlogasync.hpp"
+#include "mlogbinary.hpp"
+#include "mlogbuffer.hpp"
 #include "mlogfilemanager.hpp"
-
+#include "mlogindex.hpp"
+#include "mlogjson.hpp"
+#include "mlogmmap.hpp"
+#include "mlogpattern.hpp"
+#include "mlogsink.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
 
 class MLogger {
 public:
@@ -15,6 +39,15 @@ public:
     using Level = MLogTool::Level;
     using Out = MLogTool::OutType;
     using Color = MLogTool::ColorType;
+    using Encoding = MLogTool::Encoding;
+    using TimePrecision = MLogTool::TimePrecision;
+    using RotatePolicy = MLogFileManager::RotatePolicy;
+    using FlushPolicy = MLogFileManager::FlushPolicy;
+    using RotateInterval = MLogFileManager::RotateInterval;
+    using SinkList = std::vector<std::shared_ptr<MLogSink>>;
+
+    using CoutType = std::basic_ostream<char, std::char_traits<char>>;
+    using StandardEndLineType = CoutType &(*)(CoutType &);
 
     //----------------------------------------------------------------------------//
     // 直接对外暴露的接口
@@ -35,10 +68,96 @@ public:
         return if_unlock().link_file_detail(file_name, std::ios_base::app);
     }
 
+    // 只检查link_file_app能否成功，不打开文件：未锁定、文件名合法、
+    // 没有被其它logger使用（可以是自己当前的文件），并且可以写入
+    bool can_link_file(const std::string &file_name) const {
+        if (m_lock || file_name.empty()
+            || !MLogTool::check_filename_valid(file_name)) {
+            return false;
+        }
+        if (MLogFileManager::to_low(file_name)
+                != MLogFileManager::to_low(m_file_name)
+            && MLogFileManager::is_used(file_name)) {
+            return false;
+        }
+        std::ofstream probe(MLogFileManager::get_path_prefix() + file_name,
+                            std::ios_base::app);
+        return probe.is_open();
+    }
+
+    // 与link_file_app相同，但是无法打开时返回false而不是退出，logger保持原样
+    bool try_link_file_app(const std::string &file_name) {
+        if (!can_link_file(file_name)) return false;
+        link_file_app(file_name);
+        return true;
+    }
+
     MLogger &link_file_trunc(const std::string &file_name) {
         return if_unlock().link_file_detail(file_name, std::ios_base::trunc);
     }
 
+    // 滚动日志文件，达到大小上限或者时间边界时切换到新的文件
+    // 旧文件命名为file_name.1、file_name.2...，编号越大越新
+    // 重命名和删除旧文件由MLogFileManager的后台线程完成，不会阻塞写日志的线程
+    MLogger &link_file_rotating(const std::string &file_name,
+                                const RotatePolicy &policy) {
+        return if_unlock()
+            .link_file_detail(file_name, std::ios_base::app)
+            .set_rotate(policy);
+    }
+
+    // 二进制日志的写入入口，由MLog::binary调用
+    // 对于不是二进制模式的logger，直接格式化成一行文本
+    template <typename... Args>
+    void log_binary(std::uint32_t id, MLogBinary::SiteInfo info,
+                    const Args &...args) {
+        if (!m_output_flag) return;
+
+        if (!m_binary) {
+            Record record = log_start(info.level);
+            if (record.active()) {
+                record << ' ';
+                MLogBinary::format_text(record.m_buffer->str(), info.format,
+                                        args...);
+                record << '\n';
+            }
+            return;
+        }
+
+        const auto time_ns =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count();
+
+        MLogBuffer &buffer = MLogBuffer::acquire();
+        MLogBinary::encode_log(buffer.str(), id,
+                               static_cast<std::int64_t>(time_ns), args...);
+        commit_binary(buffer.str());
+        MLogBuffer::release(buffer);
+    }
+
+    // 二进制日志文件，只写入调用点id、时间戳和参数的原始字节，由mlog_decode还原
+    // 二进制日志文件总是截断打开，并且不会向cout输出
+    MLogger &link_file_binary(const std::string &file_name) {
+        return if_unlock().link_file_detail(file_name, std::ios_base::trunc,
+                                            FileType::BINARY);
+    }
+
+    // 基于mmap的日志文件，适合对延迟敏感的logger，总是截断打开
+    // 写入时只需要原子地预定偏移再memcpy，多个线程写同一个logger时不加锁
+    // segment_size为每次预分配和映射的大小，0表示默认的4 MiB
+    // 不支持mmap的平台上等同于link_file_trunc
+    MLogger &link_file_mmap(const std::string &file_name,
+                            std::size_t segment_size = 0) {
+#ifdef MLOG_HAS_MMAP
+        return if_unlock().link_file_detail(file_name, std::ios_base::trunc,
+                                            FileType::MMAP, segment_size);
+#else
+        static_cast<void>(segment_size);
+        return link_file_trunc(file_name);
+#endif
+    }
+
     // 指定文件流为默认日志文件，这里只是省略了文件名和打开方式参数的填写
     MLogger &link_file_default() {
         std::string filename = MLogTool::date_string() + "." + m_name + ".log";
@@ -59,6 +178,9 @@ public:
         return (*this);
     }
 
+    // 是否已经锁定
+    bool is_locked() const { return m_lock; }
+
     // 在未锁定时，只对cout输出
     MLogger &enable_cout_only() { return if_unlock().set_flags(Out::C); }
 
@@ -68,82 +190,385 @@ public:
     // 在未锁定时，同时对cout和文件流输出
     MLogger &enable_file_and_cout() { return if_unlock().set_flags(Out::CF); }
 
-    //----------------------------------------------------------------------------//
-    // 对外输出
-    // 以下模板和实例化方案参考c++ primer
-
-    // 这个最通用模板负责所有无法处理的类型
-    template <typename MessageType>
-    MLogger &operator<<(const MessageType &msg) {
-        if (!m_output_flag) { return *this; }  // 永久关闭的话直接返回
-
-        if (m_use_cout_flag) { std::cout << msg; }  // 对接到cout
-        if (m_use_file_flag && (m_logfile_ofstream != nullptr)) {
-            (*m_logfile_ofstream) << msg;
-        }  // 对接到文件流
-        return *this;
+    // 在未锁定时，增加一个输出目标，每条记录格式化一次后写入cout、文件流和所有sink
+    // 例如 add_sink(std::make_shared<MLogFileSink>("all.log"))
+    // sink列表整体替换，可以在其它线程写日志的同时调用
+    MLogger &add_sink(std::shared_ptr<MLogSink> sink) {
+        if_unlock();
+        if (sink == nullptr) return (*this);
+
+        std::shared_ptr<const SinkList> current = m_sinks.load();
+        std::shared_ptr<const SinkList> next;
+        do {
+            auto list = std::make_shared<SinkList>(*current);
+            list->push_back(sink);
+            next = std::move(list);
+        } while (!m_sinks.compare_exchange_weak(current, next));
+        m_has_sinks.store(true, std::memory_order_release);
+        retire_sinks(std::move(current));
+        return (*this);
     }
 
-    // 对于一般的指针，打印它的内容
-    template <typename MessageType>
-    MLogger &operator<<(MessageType *msg_str) {
-        if (!m_output_flag) { return *this; }  // 永久关闭的话直接返回
-
-        if (m_use_cout_flag) { std::cout << (*msg_str); }  // 对接到cout
-        if (m_use_file_flag && (m_logfile_ofstream != nullptr)) {
-            (*m_logfile_ofstream) << (*msg_str);
-        }  // 对接到文件流
-        return *this;
+    // 在未锁定时，移除所有额外的输出目标，返回时之前的记录已经写出
+    // 等待写日志的线程放下旧的列表之后，在当前线程中析构被移除的sink
+    // 因此关闭文件等工作不会落在写日志的线程上
+    MLogger &clear_sinks() {
+        if_unlock();
+        m_has_sinks.store(false, std::memory_order_release);
+        std::shared_ptr<const SinkList> retired =
+            m_sinks.exchange(std::make_shared<const SinkList>());
+        MLogAsync::drain();
+        retire_sinks(std::move(retired));
+        return (*this);
     }
 
-    // 对于string字符串，直接处理
-    MLogger &operator<<(const std::string &msg_str) {
-        if (!m_output_flag) { return *this; }  // 永久关闭的话直接返回
+    // Part 3. 日志等级
 
-        if (m_use_cout_flag) { std::cout << msg_str; }  // 对接到cout
-        if (m_use_file_flag && (m_logfile_ofstream != nullptr)) {
-            (*m_logfile_ofstream) << msg_str;
-        }  // 对接到文件流
-        return *this;
+    // 单独设置这个logger的日志等级，可以在任何线程中随时修改，不受锁定的限制
+    MLogger &set_level(Level level) {
+        const int old_level =
+            m_level.exchange(static_cast<int>(level), std::memory_order_relaxed);
+        MLogTool::change_logger_level(to_level(old_level), level);
+        return (*this);
     }
 
-    // 对于char*风格的，转换成string处理
-    MLogger &operator<<(char *msg_str_raw) {
-        return operator<<(std::string(msg_str_raw));
+    // 恢复使用全局日志等级
+    MLogger &reset_level() {
+        const int old_level =
+            m_level.exchange(inherit_level, std::memory_order_relaxed);
+        MLogTool::change_logger_level(to_level(old_level), std::nullopt);
+        return (*this);
     }
 
-    // 对于char*风格的，转换成string处理
-    MLogger &operator<<(const char *msg_str_raw) {
-        return operator<<(std::string(msg_str_raw));
+    // 这个logger当前的日志等级
+    Level get_level() const {
+        return to_level(m_level.load(std::memory_order_relaxed))
+            .value_or(MLogTool::get_level());
     }
 
-    using CoutType = std::basic_ostream<char, std::char_traits<char>>;
-    using StandardEndLineType = CoutType &(*)(CoutType &);
+    // 读取时不加锁，只有一次relaxed读取（使用全局等级时再加一次）
+    bool level_enabled(Level level) const { return get_level() <= level; }
 
-    // 为了支持std::endl的额外处理
-    MLogger &operator<<(StandardEndLineType func) {
-        if (!m_output_flag) { return *this; }  // 永久关闭的话直接返回
+    //----------------------------------------------------------------------------//
+    // 一条日志语句，在线程局部的缓冲区中组装，语句结束时整体提交一次
+    // 例如 mlog::info("A") << "x=" << x << '\n' 只会向输出追加一次完整的文本
+    // 因此多个线程同时写日志时，每一行都是完整的
+    class Record {
+    public:
+        // logger为空时不记录任何内容
+        explicit Record(MLogger *logger) {
+            if (logger == nullptr || !logger->m_output_flag) return;
+
+            m_logger = logger;
+            m_buffer = &MLogBuffer::acquire();
+        }
+
+        // pattern非空时使用这个格式模板，忽略log_start_format
+        Record(MLogger *logger, Level level, Format log_start_format,
+               const MLogPattern *pattern = nullptr)
+            : Record(logger) {
+            m_level = level;
+            if (m_buffer == nullptr) return;
+
+            if (pattern != nullptr) {
+                m_logger->write_pattern(*this, *pattern, level);
+            }
+            else { m_logger->write_start(*this, level, log_start_format); }
+            m_body_pos = m_buffer->str().size();
+            if (m_logger->m_encoding == Encoding::JSON) {
+                m_json = &MLogBuffer::acquire();
+                m_logger->write_json_start(m_json->str(), level);
+            }
+        }
+
+        Record(const Record &) = delete;
+        Record &operator=(const Record &) = delete;
+
+        // 语句结束，提交整条记录并归还缓冲区
+        ~Record() {
+            if (m_buffer == nullptr) return;
+
+            m_logger->commit(*this);
+            if (m_json != nullptr) MLogBuffer::release(*m_json);
+            MLogBuffer::release(*m_buffer);
+        }
+
+        // 这个最通用模板负责所有无法处理的类型
+        template <typename MessageType>
+        Record &operator<<(const MessageType &msg) {
+            if (m_buffer != nullptr) { m_buffer->stream() << msg; }
+            return *this;
+        }
+
+        // 对于一般的指针，打印它的内容
+        template <typename MessageType>
+        Record &operator<<(MessageType *msg_str) {
+            if (m_buffer != nullptr) { m_buffer->stream() << (*msg_str); }
+            return *this;
+        }
+
+        // 对于字符串，直接追加到缓冲区
+        Record &operator<<(const std::string &msg_str) {
+            if (m_buffer != nullptr) { m_buffer->str().append(msg_str); }
+            return *this;
+        }
+
+        Record &operator<<(char *msg_str_raw) {
+            return operator<<(static_cast<const char *>(msg_str_raw));
+        }
+
+        Record &operator<<(const char *msg_str_raw) {
+            if (m_buffer != nullptr) { m_buffer->str().append(msg_str_raw); }
+            return *this;
+        }
+
+        Record &operator<<(char ch) {
+            if (m_buffer != nullptr) { m_buffer->str().push_back(ch); }
+            return *this;
+        }
+
+        // 调用点的静态元数据只记录指针和位置，在写出时才展开
+        Record &operator<<(const MLogSite &site) {
+            if (m_buffer == nullptr) return *this;
+
+            if (m_site != nullptr) { return (*this) << MLogSite{site}; }
+            m_site = &site;
+            m_site_pos = m_buffer->str().size();
+            return *this;
+        }
+
+        // 临时的调用点信息（例如MLOG_STAMP）立即写入
+        Record &operator<<(MLogSite &&site) {
+            if (m_buffer != nullptr) { site.render(m_buffer->str()); }
+            return *this;
+        }
+
+        // 为了支持std::endl的额外处理，std::endl和std::flush会在提交后冲刷输出
+        Record &operator<<(StandardEndLineType func) {
+            if (m_buffer == nullptr) return *this;
+
+            func(m_buffer->stream());
+            if (func == static_cast<StandardEndLineType>(std::endl)
+                || func == static_cast<StandardEndLineType>(std::flush)) {
+                m_flush = true;
+            }
+            return *this;
+        }
+
+#ifdef MLOG_HAS_FORMAT
+        // std::format风格的输出，格式字符串在编译期检查
+        // 直接格式化到线程局部的记录缓冲区中，不经过ostream
+        template <typename... Args>
+        Record &format(std::format_string<Args...> fmt, Args &&...args) {
+            if (m_buffer != nullptr) {
+                std::format_to(std::back_inserter(m_buffer->str()), fmt,
+                               std::forward<Args>(args)...);
+            }
+            return *this;
+        }
+#endif
+
+        // 结构化字段，例如 mlog::info("A").kv("user", id).kv("lat_us", us).msg("done")
+        // 文本中写为 user=42 lat_us=17 done，JSON模式的logger同时写出一行JSON
+        // 其它类型的值通过operator<<转换为字符串
+        template <typename T>
+        Record &kv(std::string_view key, const T &value) {
+            if (m_buffer == nullptr) return *this;
+
+            std::string &text = m_buffer->str();
+            text.push_back(' ');
+            text.append(key).push_back('=');
+            const std::size_t pos = text.size();
+            if constexpr (MLogJson::is_value<T>) {
+                MLogJson::append_text(text, value);
+                if (m_json != nullptr) {
+                    MLogJson::append_key(m_json->str(), key);
+                    MLogJson::append_json(m_json->str(), value);
+                }
+            }
+            else {
+                m_buffer->stream() << value;
+                if (m_json != nullptr) {
+                    MLogJson::append_key(m_json->str(), key);
+                    MLogJson::append_string(m_json->str(),
+                                            std::string_view{text}.substr(pos));
+                }
+            }
+            m_has_fields = true;
+            return *this;
+        }
+
+        // 结构化记录的消息，JSON中的键为msg
+        Record &msg(std::string_view message) {
+            if (m_buffer == nullptr) return *this;
+
+            m_buffer->str().push_back(' ');
+            m_buffer->str().append(message);
+            if (m_json != nullptr) {
+                MLogJson::append_key(m_json->str(), "msg");
+                MLogJson::append_string(m_json->str(), message);
+                m_has_msg = true;
+            }
+            m_has_fields = true;
+            return *this;
+        }
+
+        // 当前记录是否会被输出
+        bool active() const { return m_buffer != nullptr; }
+
+    private:
+        friend class MLogger;
+
+        // 提交之前补全结构化记录：文本补上换行，JSON补上msg和结尾
+        // 只用<<写入的记录在JSON中把正文作为msg
+        void finish_structured() {
+            std::string &text = m_buffer->str();
+            if (m_has_fields && (text.empty() || text.back() != '\n')) {
+                text.push_back('\n');
+            }
+            if (m_json == nullptr) return;
+
+            std::string &json = m_json->str();
+            if (!m_has_fields) {
+                std::string_view body = std::string_view{text}.substr(
+                    std::min(m_body_pos, text.size()));
+                while (!body.empty() && body.back() == '\n') {
+                    body.remove_suffix(1);
+                }
+                if (body.starts_with(' ')) body.remove_prefix(1);
+                MLogJson::append_key(json, "msg");
+                MLogJson::append_string(json, body);
+            }
+            json.append("}\n");
+        }
+
+        MLogger *m_logger{nullptr};
+        MLogBuffer *m_buffer{nullptr};
+        MLogBuffer *m_json{nullptr};  // JSON模式的logger的结构化记录
+        std::size_t m_body_pos{0};    // 记录开头之后的正文位置
+        const char *m_color{nullptr};  // 记录开头的m_color_len个字符在cout上着色
+        std::size_t m_color_len{0};
+        const MLogSite *m_site{nullptr};  // 调用点元数据，展开在m_site_pos处
+        std::size_t m_site_pos{0};
+        // 格式模板中调用点信息的位置，非空时代替默认的调用点文本
+        std::array<MLogPattern::SiteSlot, MLogPattern::max_site_slots>
+            m_site_slots{};
+        std::size_t m_site_slot_count{0};
+        Level m_level{Level::on};
+        bool m_flush{false};
+        bool m_has_fields{false};  // 使用过kv或者msg
+        bool m_has_msg{false};
+    };
 
-        if (m_use_cout_flag) func(std::cout);
-        if (m_use_file_flag) { func(*m_logfile_ofstream); }
+    //----------------------------------------------------------------------------//
+    // 对外输出
+    // 直接对logger使用<<时，每次插入都是一条独立提交的记录
 
+    template <typename MessageType>
+    MLogger &operator<<(const MessageType &msg) {
+        Record{this} << msg;
+        return *this;
+    }
+
+    template <typename MessageType>
+    MLogger &operator<<(MessageType *msg_str) {
+        Record{this} << msg_str;
+        return *this;
+    }
+
+    MLogger &operator<<(StandardEndLineType func) {
+        Record{this} << func;
         return *this;
     }
 
     //----------------------------------------------------------------------------//
 
     MLogger &flush() {
+        // 异步模式下由后台线程冲刷，并等待队列中已有的记录全部写出
+        if (MLogAsync::enabled()) {
+            MLogAsync::Item &item = async_item();
+            item.reset(this);
+            item.use_cout = true;
+            item.use_file = true;
+            item.flush = true;
+            MLogAsync::push(item);
+            MLogAsync::drain();
+            flush_sinks();
+            return *this;
+        }
+
+        std::lock_guard<std::mutex> console_lock(MLogTool::console_mutex());
+        std::lock_guard<std::mutex> lock(m_mutex);
+
         // 无论是否对接到cout
         std::cout.flush();
         // 无论flag是否对接到文件流，只要可以访问这个流
         if (m_logfile_ofstream != nullptr) { m_logfile_ofstream->flush(); }
+        if (m_mmap_file != nullptr) { m_mmap_file->flush(); }
+        flush_sinks();
         return *this;
     }
 
     //----------------------------------------------------------------------------//
 
+    // 在未锁定时设置文件的冲刷策略，计数和计时从现在开始
+    // 例如 set_flush_policy({.level = mlog::Level::warn, .on_endl = false,
+    //                        .buffer_size = 1 << 16})
+    // 缓冲区大小在下一次打开文件时生效，因此通常在link_file_*之前调用
+    MLogger &set_flush_policy(const FlushPolicy &policy) {
+        if_unlock();
+        MLogAsync::drain();  // 后台线程可能正在读取冲刷策略
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_flush_policy = policy;
+        m_unflushed_records.store(0, std::memory_order_relaxed);
+        m_last_flush_ms.store(steady_ms(), std::memory_order_relaxed);
+        return (*this);
+    }
+
+    // 在日志文件旁边写一个索引（文件名加上.idx），每写入interval字节记录一项，0表示不写索引
+    // 读取时通过MLogIndex::load和MLogIndex::select直接定位到某个时间范围或者等级
+    // 在下一次打开文件时生效，只支持普通的文本文件，滚动的文件不写索引
+    MLogger &set_file_index(std::size_t interval) {
+        if_unlock();
+        m_index_interval = interval;
+        return (*this);
+    }
+
+    // 文件的编码，JSON模式下每条带等级的记录在文件中写为一行JSON（JSON Lines）
+    // cout总是写入文本，sink可以通过MLogSink::set_encoding选择
+    MLogger &set_encoding(Encoding encoding) {
+        if_unlock();
+        m_encoding = encoding;
+        return (*this);
+    }
+
     MLogger &set_format(Format log_format) {
-        m_log_start_format = log_format;
+        m_log_start_format.store(log_format, std::memory_order_relaxed);
+        m_has_pattern.store(false, std::memory_order_release);
+        m_pattern.store(nullptr);
+        return (*this);
+    }
+
+    // 使用格式模板代替固定的格式，模板在这里编译一次，例如
+    // set_pattern("%Y-%m-%d %H:%M:%S.%f [%l] {%n} %t %s ")
+    // 标记的含义见MLogPattern，空模板表示恢复使用set_format的格式
+    // 与set_format以最后一次设置为准
+    // 新模板在旁边编译好之后整体发布，正在写日志的线程继续使用之前读取到的模板
+    MLogger &set_pattern(std::string_view pattern) {
+        if_unlock();
+        std::shared_ptr<const MLogPattern> compiled;
+        if (!pattern.empty()) {
+            compiled = std::make_shared<const MLogPattern>(pattern);
+        }
+        m_has_pattern.store(compiled != nullptr, std::memory_order_release);
+        m_pattern.store(std::move(compiled));
+        return (*this);
+    }
+
+    // 时间戳的小数部分精度，默认为毫秒，可以在其它线程写日志的同时修改
+    MLogger &set_time_precision(TimePrecision precision) {
+        m_time_precision.store(precision, std::memory_order_relaxed);
         return (*this);
     }
 
@@ -178,15 +603,28 @@ public:
 private:
     friend class MLoggerManager;
 
+    // 日志文件的类型
+    enum class FileType {
+        TEXT = 0,  // 普通的文本文件
+        BINARY,    // 二进制日志文件
+        MMAP,      // 基于mmap的文本文件
+    };
+
     // 核心方法，不负责检查是否锁定，这是内层方法
     // 改变文件流为其它文件流，并负责打开文件
     // 失败则绑定nullptr
     // 析构时不会负责关闭，由MLogFileManager的单例负责逐个关闭
     MLogger &link_file_detail(const std::string &file_name,
-                              const std::ios_base::openmode mode) {
+                              std::ios_base::openmode mode,
+                              FileType type = FileType::TEXT,
+                              std::size_t segment_size = 0) {
         // 妥善收尾
         clean_file_and_ofstream(true);
 
+        m_binary = (type == FileType::BINARY);
+        m_binary_sites.clear();
+        if (m_binary) mode |= std::ios_base::binary;
+
         auto full_file_name = MLogFileManager::get_path_prefix() + file_name;
 
         // 尝试获取新文件流，不负责检查合法性和唯一性
@@ -200,17 +638,54 @@ private:
         }
 
         // 获取了新的文件句柄，
-        // 尝试打开文件
-        m_logfile_ofstream->open(full_file_name, std::ios_base::out | mode); // NOLINT(hicpp-signed-bitwise)
+        // 尝试打开文件，mmap文件的ofstream不会打开，只用来占用文件名
+        bool opened = false;
+        if (type == FileType::MMAP) {
+            m_mmap_file = std::make_unique<MLogMmapFile>();
+            opened = m_mmap_file->open(full_file_name, segment_size);
+            if (!opened) m_mmap_file = nullptr;
+        }
+        else {
+            // 用户空间缓冲区必须在打开之前设置，滚动时重新打开仍然使用它
+            if (m_flush_policy.buffer_size > 0) {
+                m_file_buffer =
+                    std::make_unique<char[]>(m_flush_policy.buffer_size);
+                m_logfile_ofstream->rdbuf()->pubsetbuf(
+                    m_file_buffer.get(),
+                    static_cast<std::streamsize>(m_flush_policy.buffer_size));
+            }
+            m_logfile_ofstream->open(full_file_name, std::ios_base::out | mode); // NOLINT(hicpp-signed-bitwise)
+            opened = !m_logfile_ofstream->fail();
+        }
 
         // 没有打开文件，报错退出
-        if (m_logfile_ofstream->fail()) {
+        if (!opened) {
             set_flags(Out::C)
                 .clean_file_and_ofstream(true)
                 .notice_open_file_failed_and_exit(full_file_name);
         }
 
         m_file_name = file_name;  // 记录更新日志文件名
+        m_last_flush_ms.store(steady_ms(), std::memory_order_relaxed);
+
+        // 索引在写入开头的提示之前打开，从而覆盖整个文件
+        if (type == FileType::TEXT && m_index_interval > 0) {
+            m_index = std::make_unique<MLogIndex>();
+            if (!m_index->open(full_file_name, m_name, m_index_interval,
+                               (mode & std::ios_base::trunc) != 0)) {
+                m_index = nullptr;
+            }
+        }
+
+        // 二进制日志文件先写入文件头
+        if (m_binary) {
+            std::string header;
+            MLogBinary::encode_header(header, m_name, start_format(),
+                                      time_precision());
+            m_logfile_ofstream->write(header.data(),
+                                      static_cast<std::streamsize>(header.size()));
+        }
+
         // 成功打开新的日志文件，在写日志之前加入固定的前缀
         return set_flags(Out::F).notice_open_file();
     }
@@ -218,17 +693,13 @@ private:
     MLogger &log_with_color(const std::string &message, Color color) {
         switch (color) {
         case Color::RED:
-            return log_with_color_detail(message, MLogTool::ansi_color_red,
-                                         MLogTool::ansi_color_end);
+            return log_with_color_detail(message, MLogTool::ansi_color_red);
         case MLogTool::ColorType::GREEN:
-            return log_with_color_detail(message, MLogTool::ansi_color_green,
-                                         MLogTool::ansi_color_end);
+            return log_with_color_detail(message, MLogTool::ansi_color_green);
         case MLogTool::ColorType::YELLOW:
-            return log_with_color_detail(message, MLogTool::ansi_color_yellow,
-                                         MLogTool::ansi_color_end);
+            return log_with_color_detail(message, MLogTool::ansi_color_yellow);
         case MLogTool::ColorType::BLUE:
-            return log_with_color_detail(message, MLogTool::ansi_color_blue,
-                                         MLogTool::ansi_color_end);
+            return log_with_color_detail(message, MLogTool::ansi_color_blue);
         case MLogTool::ColorType::NONE:
         default: return (*this);
         }
@@ -236,58 +707,379 @@ private:
 
     // 颜色输出需要前缀和后缀，但向文件中输出会自动删除这些特殊字符
     MLogger &log_with_color_detail(const std::string &message,
-                                   const char *color_prefix,
-                                   const char *color_suffix) {
-        if (!m_output_flag) return (*this);
+                                   const char *color_prefix) {
+        Record record{this};
+        if (record.active()) {
+            record << message;
+            record.m_color = color_prefix;
+            record.m_color_len = message.size();
+        }
+        return (*this);
+    }
+
+    // 提交一条完整的记录
+    // 异步模式下放入队列，由后台线程展开调用点信息
+    // 否则展开后加锁直接写出，每条记录只加锁一次
+    void commit(Record &record) {
+        record.finish_structured();
+        if (record.m_site_slot_count > 0 && record.m_site != nullptr) {
+            MLogPattern::render_site(record.m_buffer->str(), *record.m_site,
+                                     record.m_site_slots,
+                                     record.m_site_slot_count,
+                                     record.m_color_len);
+            record.m_site = nullptr;
+        }
+        std::string &text = record.m_buffer->str();
+        if (text.empty() && record.m_site == nullptr && !record.m_flush) return;
+
+        const bool use_file =
+            m_use_file_flag && (m_logfile_ofstream != nullptr);
+
+        if (MLogAsync::enabled()) {
+            MLogAsync::Item &item = async_item();
+            item.reset(this);
+            item.text.append(text);
+            if (record.m_json != nullptr) item.json.append(record.m_json->str());
+            item.color = record.m_color;
+            item.color_len = record.m_color_len;
+            item.site = record.m_site;
+            item.site_pos = record.m_site_pos;
+            item.level = record.m_level;
+            item.use_cout = m_use_cout_flag;
+            item.use_file = use_file;
+            item.flush = record.m_flush;
+            MLogAsync::push(item);
+            return;
+        }
+
+        if (record.m_site != nullptr) {
+            record.m_site->render_at(text, record.m_site_pos);
+        }
 
+        // 记录只格式化一次，所有输出共享同一份字节
+        const MLogRecordView view{
+            text,
+            record.m_level,
+            record.m_color,
+            record.m_color_len,
+            record.m_flush,
+            record.m_json != nullptr ? record.m_json->str() : std::string_view{}};
         if (m_use_cout_flag) {
-            std::cout << color_prefix << message << color_suffix;
+            std::lock_guard<std::mutex> lock(MLogTool::console_mutex());
+            MLogConsoleSink::write_colored(std::cout, view);
+        }
+        // mmap文件自己处理并发写入，不需要加锁
+        if (use_file && m_mmap_file != nullptr) {
+            write_file(view);
+        }
+        else if (use_file) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            write_file(view);
+        }
+        write_sinks(view);
+    }
+
+    // 被替换下来的列表已经不再发布，持有它的只有正在写一条记录的线程，很快就会释放
+    // 等它们放下之后在当前线程中释放列表，每个列表都这样退役，
+    // 因此写日志的线程永远不会释放sink的最后一个引用
+    static void retire_sinks(std::shared_ptr<const SinkList> retired) {
+        while (retired.use_count() > 1) std::this_thread::yield();
+    }
+
+    void flush_sinks() {
+        if (!m_has_sinks.load(std::memory_order_acquire)) return;
+
+        const std::shared_ptr<const SinkList> sinks = m_sinks.load();
+        for (const auto &sink : *sinks) sink->flush();
+    }
+
+    // 等级为off的记录是logger自己的提示（例如MLOG START），不写入sink
+    // 没有sink时只读取一次标志，有sink时使用当前发布的列表
+    void write_sinks(const MLogRecordView &view) {
+        if (view.text.empty() || view.level == Level::off
+            || !m_has_sinks.load(std::memory_order_acquire)) {
+            return;
         }
 
-        if (m_use_file_flag && (m_logfile_ofstream != nullptr)) {
-            (*m_logfile_ofstream) << message;
+        const std::shared_ptr<const SinkList> sinks = m_sinks.load();
+        for (const auto &sink : *sinks) {
+            if (sink->accepts(view.level)) sink->write(view);
         }
+    }
+
+    static std::optional<Level> to_level(int level) {
+        if (level == inherit_level) return std::nullopt;
+        return static_cast<Level>(level);
+    }
+
+    // 二进制日志文件中的文本记录需要加上记录头
+    // JSON模式的logger写入结构化记录的JSON编码
+    void write_file(const MLogRecordView &view) {
+        const std::string_view text = view.json.empty() ? view.text : view.json;
+        // 没有内容的记录来自flush()，总是冲刷
+        const bool flush = text.empty() ? view.flush : need_flush(view);
+        if (m_mmap_file != nullptr) {
+            m_mmap_file->append(text);
+            if (flush) m_mmap_file->flush();
+            return;
+        }
+        if (m_logfile_ofstream == nullptr) return;
+
+        if (m_binary) {
+            const auto len = static_cast<std::uint32_t>(text.size());
+            char head[1 + sizeof(len)]{MLogBinary::tag_text};
+            std::memcpy(static_cast<char *>(head) + 1, &len, sizeof(len));
+            m_logfile_ofstream->write(static_cast<char *>(head), sizeof(head));
+        }
+        m_logfile_ofstream->write(text.data(),
+                                  static_cast<std::streamsize>(text.size()));
+        if (flush) m_logfile_ofstream->flush();
+        if (m_index != nullptr) m_index->add(text.size(), view.level);
+
+        if (m_rotate.add(text.size())) rotate_file();
+    }
 
+    // 按照冲刷策略判断写入这条记录之后是否冲刷文件
+    // mmap文件的写入不加锁，因此计数和时间都使用原子变量
+    bool need_flush(const MLogRecordView &view) {
+        const FlushPolicy &policy = m_flush_policy;
+        bool result = (view.flush && policy.on_endl)
+                      || (policy.level != Level::off && view.level >= policy.level);
+        if (policy.every_records > 0) {
+            result = result
+                     || m_unflushed_records.fetch_add(1, std::memory_order_relaxed)
+                                + 1
+                            >= policy.every_records;
+        }
+
+        std::int64_t now = 0;
+        if (policy.interval.count() > 0) {
+            now = steady_ms();
+            result = result
+                     || now - m_last_flush_ms.load(std::memory_order_relaxed)
+                            >= policy.interval.count();
+        }
+
+        if (result) {
+            m_unflushed_records.store(0, std::memory_order_relaxed);
+            m_last_flush_ms.store(now, std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    static std::int64_t steady_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    // 开始滚动
+    MLogger &set_rotate(const RotatePolicy &policy) {
+        // 异步模式下后台线程可能正在写这个文件
+        MLogAsync::drain();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_index = nullptr;  // 滚动之后偏移不再对应同一个文件
+        m_rotate.start(m_file_name, policy);
         return (*this);
     }
 
-    // 外部指定格式
-    MLogger &log_start(Level level, Format log_start_format) {
+    // 切换到新的文件，调用者已经持有文件流的锁（或者位于异步后台线程）
+    void rotate_file() {
+        write_notice_line(" MLOG END\n");
+        if (m_rotate.rotate(*m_logfile_ofstream)) {
+            write_notice_line(" MLOG START\n");
+        }
+    }
+
+    // 滚动时直接写入文件的提示行，格式与notice_open_file一致
+    // 此时已经持有文件流的锁，因此不能通过Record提交
+    void write_notice_line(const char *message) {
+        std::string line;
+        if (m_encoding == Encoding::JSON) {
+            std::string_view msg{message};
+            while (!msg.empty() && (msg.front() == ' ' || msg.back() == '\n')) {
+                if (msg.front() == ' ') { msg.remove_prefix(1); }
+                else { msg.remove_suffix(1); }
+            }
+            write_json_start(line, Level::off);
+            MLogJson::append_key(line, "msg");
+            MLogJson::append_string(line, msg);
+            line.append("}\n");
+        }
+        else {
+            line = MLogTool::level_stamp(Level::off) + m_signature;
+            append_time_stamp(line);
+            line.append(message);
+        }
+        m_logfile_ofstream->write(line.data(),
+                                  static_cast<std::streamsize>(line.size()));
+        m_rotate.add(line.size());
+    }
+
+    // 写出一条二进制日志记录，调用点第一次出现在这个文件中时先写出它的定义
+    void write_binary(const std::string &record) {
+        if (m_logfile_ofstream == nullptr || !m_binary) return;
+
+        const std::uint32_t id = MLogBinary::log_id(record);
+        if (id == MLogBinary::invalid_id) return;
+
+        if (m_binary_sites.size() <= id) m_binary_sites.resize(id + 1, false);
+        if (!m_binary_sites[id]) {
+            std::string def;
+            MLogBinary::encode_site(def, id, MLogBinary::site(id));
+            m_logfile_ofstream->write(def.data(),
+                                      static_cast<std::streamsize>(def.size()));
+            m_binary_sites[id] = true;
+        }
+
+        m_logfile_ofstream->write(record.data(),
+                                  static_cast<std::streamsize>(record.size()));
+    }
+
+    // 提交一条二进制日志记录，只写入文件
+    void commit_binary(const std::string &record) {
+        if (MLogAsync::enabled()) {
+            MLogAsync::Item &item = async_item();
+            item.reset(this);
+            item.text.append(record);
+            item.use_file = true;
+            item.binary = true;
+            MLogAsync::push(item);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        write_binary(record);
+    }
+
+    // 每个线程复用同一个待入队记录，入队时和队列槽位交换缓冲区，稳定之后不再分配
+    static MLogAsync::Item &async_item() {
+        thread_local MLogAsync::Item item;
+        return item;
+    }
+
+    // 在后台线程中写出一条记录，只有MLogAsync的后台线程会调用
+    void write_async_item(MLogAsync::Item &item) {
+        if (item.site != nullptr) { item.site->render_at(item.text, item.site_pos); }
+
+        if (item.binary) {
+            write_binary(item.text);
+            return;
+        }
+
+        const MLogRecordView view{item.text,      item.level, item.color,
+                                  item.color_len, item.flush, item.json};
+        if (item.use_cout) { MLogConsoleSink::write_colored(std::cout, view); }
+        if (item.use_file) { write_file(view); }
+        write_sinks(view);
+    }
+
+    // 把记录的开头按照格式写入缓冲区
+    void write_start(Record &record, Level level, Format log_start_format) {
+        std::string &buffer = record.m_buffer->str();
+
         switch (log_start_format) {
         case Format::LEVEL_SIGNATURE_TIME:
-            return (*this) << MLogTool::level_stamp(level) << m_signature
-                           << MLogTool::time_stamp();
+            buffer.append(MLogTool::level_stamp(level)).append(m_signature);
+            append_time_stamp(buffer);
+            break;
         case Format::LEVEL_SIGNATURE:
-            return (*this) << MLogTool::level_stamp(level) << m_signature;
+            buffer.append(MLogTool::level_stamp(level)).append(m_signature);
+            break;
         case Format::LEVEL_TIME:
-            return (*this) << MLogTool::level_stamp(level)
-                           << MLogTool::time_stamp();
-        case Format::LEVEL: return (*this) << MLogTool::level_stamp(level);
-        case Format::NONE: return (*this);
+            buffer.append(MLogTool::level_stamp(level));
+            append_time_stamp(buffer);
+            break;
+        case Format::LEVEL: buffer.append(MLogTool::level_stamp(level)); break;
         case Format::LEVEL_COLOR:
-            switch (level) {
-            case Level::debug:
-                return log_with_color(MLogTool::level_stamp(level),
-                                      Color::BLUE);
-            case Level::info:
-                return log_with_color(MLogTool::level_stamp(level),
-                                      Color::GREEN);
-            case Level::warn:
-                return log_with_color(MLogTool::level_stamp(level),
-                                      Color::YELLOW);
-            case Level::error:
-                return log_with_color(MLogTool::level_stamp(level), Color::RED);
-            case Level::on:
-            case Level::off:
-            default: return (*this) << MLogTool::level_stamp(level);
-            }
-        default: return (*this);
+            buffer.append(MLogTool::level_stamp(level));
+            record.m_color = level_color(level);
+            record.m_color_len = (record.m_color != nullptr) ? buffer.size() : 0;
+            break;
+        case Format::NONE:
+        default: break;
+        }
+    }
+
+    // 按照编译好的格式模板写入记录的开头
+    void write_pattern(Record &record, const MLogPattern &pattern,
+                       Level level) const {
+        std::string &buffer = record.m_buffer->str();
+
+        MLogPattern::Context ctx;
+        ctx.level = level;
+        ctx.name = m_name;
+        ctx.slots = &record.m_site_slots;
+        ctx.slot_count = &record.m_site_slot_count;
+        pattern.format(buffer, ctx);
+
+        if (pattern.colored()) {
+            record.m_color = level_color(level);
+            record.m_color_len = (record.m_color == nullptr) ? 0
+                                 : (ctx.color_len > 0)      ? ctx.color_len
+                                                            : buffer.size();
         }
     }
 
-    // 使用自带的格式
-    MLogger &log_start(Level level) {
-        return log_start(level, m_log_start_format);
+    // JSON记录的开头，之后的字段依次追加，提交时补上结尾
+    // 例如 {"time":"2016-06-21 20:54:11.123","level":"INFO","logger":"A"
+    void write_json_start(std::string &json, Level level) const {
+        char stamp[MLogTool::time_stamp_max_size];
+        const std::size_t len =
+            MLogTool::time_stamp(static_cast<char *>(stamp), time_precision());
+        const std::string &level_str = MLogTool::level_stamp(level);
+
+        json.append(R"({"time":")").append(static_cast<char *>(stamp) + 1, len - 2);
+        json.append(R"(","level":")");
+        // logger自己的提示没有等级
+        if (level == Level::on || level == Level::off) { json.append("MLOG"); }
+        else { json.append(level_str, 1, level_str.size() - 2); }
+        json.append(R"(","logger":)");
+        MLogJson::append_string(json, m_name);
+    }
+
+    // 时间戳先写入栈上的缓冲区，再追加到记录中
+    void append_time_stamp(std::string &buffer) const {
+        char stamp[MLogTool::time_stamp_max_size];
+        buffer.append(static_cast<char *>(stamp),
+                      MLogTool::time_stamp(static_cast<char *>(stamp),
+                                           time_precision()));
+    }
+
+    static const char *level_color(Level level) {
+        switch (level) {
+        case Level::debug: return MLogTool::ansi_color_blue;
+        case Level::info: return MLogTool::ansi_color_green;
+        case Level::warn: return MLogTool::ansi_color_yellow;
+        case Level::error: return MLogTool::ansi_color_red;
+        case Level::on:
+        case Level::off:
+        default: return nullptr;
+        }
+    }
+
+    // 外部指定格式，开始一条新的记录
+    Record log_start(Level level, Format log_start_format) {
+        return Record{this, level, log_start_format};
+    }
+
+    // 使用自带的格式，设置了格式模板时使用模板
+    // 模板只在记录开头使用，读取到的模板在构造记录期间保持有效
+    Record log_start(Level level) {
+        if (!m_has_pattern.load(std::memory_order_acquire)) {
+            return Record{this, level, start_format()};
+        }
+        const auto pattern = m_pattern.load();
+        return Record{this, level, start_format(), pattern.get()};
+    }
+
+    Format start_format() const {
+        return m_log_start_format.load(std::memory_order_relaxed);
+    }
+
+    TimePrecision time_precision() const {
+        return m_time_precision.load(std::memory_order_relaxed);
     }
 
     // 建议只采用cout或者file单通道输出，并且通常情况下会自动进行切换不需要设置
@@ -326,15 +1118,26 @@ private:
     }
 
     MLogger &clean_file_and_ofstream(bool erase_flag) {
+        // 异步模式下后台线程可能还在使用当前的文件流
+        MLogAsync::drain();
+
         if (m_logfile_ofstream) {
             // 关闭文件
-            if (m_logfile_ofstream->is_open()) {
+            if (m_logfile_ofstream->is_open() || m_mmap_file != nullptr) {
                 // 正常状态就向这个文件流写入结束语
                 set_flags(Out::F).notice_close_file().set_flags(Out::C);
 
+                // 异步模式下需要先等待这个文件的记录全部写出
+                MLogAsync::drain();
+
                 m_logfile_ofstream->flush();
                 m_logfile_ofstream->close();
+                if (m_mmap_file != nullptr) m_mmap_file->close();
+                if (m_index != nullptr) m_index->close();
             }
+
+            // 等待后台线程把滚动的文件改回正确的名字
+            m_rotate.stop();
             if (erase_flag) {
                 MLogFileManager::erase_unique_ofstream(
                     m_file_name);  // 清理ofstream，在析构时不会调用，否则因为析构顺序可能有异常
@@ -344,6 +1147,10 @@ private:
         // 清理内部数据
         m_file_name = std::string();
         m_logfile_ofstream = nullptr;
+        m_file_buffer = nullptr;  // 文件流已经关闭，不会再使用这个缓冲区
+        m_mmap_file = nullptr;
+        m_index = nullptr;
+        m_binary = false;
         std::cout.flush();
 
         return (*this);
@@ -365,21 +1172,44 @@ private:
     std::string
         m_file_name;  // 日志文件名是不含前缀的，并且需要通过文件名合法性检查
     bool m_lock{false};  // 加锁后只可以使用输出，不能用对外接口改变输出方式
-    Format m_log_start_format{
+    constexpr static int inherit_level = -1;
+    std::atomic<int> m_level{inherit_level};  // 单独设置的等级，-1表示使用全局等级
+    std::mutex m_mutex;  // 保护文件流，每条记录提交时只加锁一次
+    std::unique_ptr<MLogMmapFile> m_mmap_file;  // 非空时代替文件流写入
+    std::unique_ptr<char[]> m_file_buffer;  // 文件流的用户空间缓冲区
+    std::unique_ptr<MLogIndex> m_index;     // 非空时同时写入旁路索引
+    std::size_t m_index_interval{0};        // 索引每一项覆盖的字节数
+    FlushPolicy m_flush_policy;
+    Encoding m_encoding{Encoding::TEXT};
+    // 编译好的格式模板，非空时代替m_log_start_format，修改时整体替换
+    std::atomic<std::shared_ptr<const MLogPattern>> m_pattern;
+    std::atomic<bool> m_has_pattern{false};  // 是否设置了模板，没有模板时不需要读取
+    std::atomic<std::size_t> m_unflushed_records{0};  // 上次冲刷之后写入的记录数
+    std::atomic<std::int64_t> m_last_flush_ms{0};     // 上次冲刷的时刻
+    // 额外的输出目标，修改时发布一个新的列表，写日志的线程持有读取到的列表直到写完
+    std::atomic<std::shared_ptr<const SinkList>> m_sinks{
+        std::make_shared<const SinkList>()};
+    std::atomic<bool> m_has_sinks{false};  // 列表是否非空，没有sink时不需要读取列表
+    bool m_binary{false};              // 当前文件是否为二进制日志
+    std::vector<bool> m_binary_sites;  // 已经写入当前文件的调用点定义
+    MLogFileManager::Rotator m_rotate;  // 当前文件的滚动状态
+    std::atomic<Format> m_log_start_format{
         Format::LEVEL_SIGNATURE};  // 普通日志默认使用的开头格式
+    std::atomic<TimePrecision> m_time_precision{
+        TimePrecision::MILLI};  // 时间戳的小数部分精度
 
     //----------------------------------------------------------------------------//
 
     // 提示打开日志文件，日志等级off，日志戳为等级和签名和时间
     MLogger &notice_open_file() {
-        return log_start(Level::off, Format::LEVEL_SIGNATURE_TIME)
-               << " MLOG START\n";
+        log_start(Level::off, Format::LEVEL_SIGNATURE_TIME) << " MLOG START\n";
+        return (*this);
     }
 
     // 提示关闭日志文件，日志等级off，日志戳为等级和签名和时间
     MLogger &notice_close_file() {
-        return log_start(Level::off, Format::LEVEL_SIGNATURE_TIME)
-               << " MLOG END\n";
+        log_start(Level::off, Format::LEVEL_SIGNATURE_TIME) << " MLOG END\n";
+        return (*this);
     }
 
     // 通知无效名称，然后报错退出
@@ -417,4 +1247,21 @@ private:
     }
 };
 
+// 指向一个logger的轻量句柄，可以保存下来反复使用，写日志时不再需要按名称查找
+// logger在程序结束之前不会被销毁，因此句柄一直有效
+// 例如 MLoggerHandle net = mlog::create_logger("net"); mlog::info(net) << ...
+class MLoggerHandle {
+public:
+    MLoggerHandle(MLogger &logger) : m_logger(&logger) {} // NOLINT(google-explicit-constructor)
+
+    MLogger &get() const { return *m_logger; }
+
+    MLogger &operator*() const { return *m_logger; }
+
+    MLogger *operator->() const { return m_logger; }
+
+private:
+    MLogger *m_logger;
+};
+
 #endif  // MLOGGER_H_
@@ -1,9 +1,17 @@
 #ifndef MLOGGERMANAGER_H_
 #define MLOGGERMANAGER_H_
 
+#include "mlog_macro.hpp"
+
 #include "mlogger.hpp"
 
+#include <atomic>
 #include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
 
 // 负责日志等级判定
 class MLoggerManager {
@@ -11,77 +19,102 @@ public:
     using Format = MLogTool::LogStartFormat;
     using Level = MLogTool::Level;
     using OutType = MLogTool::OutType;
+    using Record = MLogger::Record;
 
     MLoggerManager(const MLoggerManager &) = delete;
     MLoggerManager &operator=(const MLoggerManager &) = delete;
 
     // 创建MLogger对象,默认不向任何位置输出
-    // 名称具有唯一性，因此如果重名返回原来的对象
-    // 通过注册map保存
+    // 名称具有唯一性，通过注册map保存
     // 对已经存在的直接报错
+    // 可以在其它线程写日志的同时创建，初始化完成之后才能被其它线程查找到
     static MLogger &create_logger(const std::string &logger_name) {
+        // 检查名称的合法性
+        // 如果空字符串或者名称不合法，报错
+        if (logger_name.empty()
+            || !MLogTool::check_filename_valid(logger_name)) {
+            get_logger_cout().notice_invalid_name_and_exit(logger_name);
+        }
+
+        MLogger *logger = register_logger(logger_name);
+
         // 如果logger已经存在则报错结束
-        if (logger_map().find(logger_name) != logger_map().end()) {
-            logger_map()["cout"].log_start(Level::on,
-                                           Format::LEVEL_SIGNATURE_TIME)
+        if (logger == nullptr) {
+            get_logger_cout().log_start(Level::on, Format::LEVEL_SIGNATURE_TIME)
                 << " The logger named \"" << logger_name
                 << "\" already exists. Can not create it again.)\n";
 
             MLogTool::raise_error();
         }
 
-        // 检查名称的合法性
-        // 如果空字符串或者名称不合法，报错
-        if (logger_name.empty()
-            || !MLogTool::check_filename_valid(logger_name)) {
-            logger_map()["cout"].notice_invalid_name_and_exit(logger_name);
-        }
-
-        return logger_map()[logger_name].init_register(logger_name, true,
-                                                       OutType::C);
+        return *logger;
     }
 
     // 如果没有在map找到，不会自动新建
-    static MLogger &get_logger(const std::string &logger_name) {
+    // 通过哈希索引查找一次，字面量名称不需要构造临时的std::string
+    static MLogger &get_logger(std::string_view logger_name) {
+        MLogger *logger = find_logger(logger_name);
+
         // 如果没有在map找到，不会自动新建，报错结束
-        if (logger_map().find(logger_name) == logger_map().end()) {
-            logger_map()["cout"].log_start(Level::on,
-                                           Format::LEVEL_SIGNATURE_TIME)
-                << " Can not find a logger named \"" << logger_name
+        if (logger == nullptr) {
+            get_logger_cout().log_start(Level::on, Format::LEVEL_SIGNATURE_TIME)
+                << " Can not find a logger named \"" << std::string{logger_name}
                 << "\". Please create it. (Maybe you forgot to use "
                    "MLog::init().)\n";
 
             MLogTool::raise_error();
         }
 
-        return logger_map().find(logger_name)->second;
+        return *logger;
+    }
+
+    // 没有找到时返回nullptr
+    // 只读取当前发布的索引，不加锁，可以和create_logger同时调用
+    static MLogger *find_logger(std::string_view logger_name) {
+        return get_instance()
+            .m_index.load(std::memory_order_acquire)
+            ->find(logger_name);
     }
 
     //----------------------------------------------------------------------------//
 
     // 标准MLogger对象cout，向cout输出
-    static MLogger &get_logger_cout() { return logger_map()["cout"]; }
+    static MLogger &get_logger_cout() {
+        static MLogger &the_cout_logger = logger_entry("cout");
+        return the_cout_logger;
+    }
 
     // 标准MLogger对象__none__，关闭所有输出
-    static MLogger &get_logger_none() { return logger_map()["__none__"]; }
+    static MLogger &get_logger_none() {
+        static MLogger &the_none_logger = logger_entry("__none__");
+        return the_none_logger;
+    }
 
     //----------------------------------------------------------------------------//
 
-    // 如果满足条件返回MLogger单例cout，自动加标签
-    // 否则返回MLogger单例__none__
-    static MLogger &get_logger_when(Level level) {
-        return (MLogTool::get_level_instance() <= level)
-                   ? get_logger_cout().log_start(level)
-                   : get_logger_none();
+    // 先和所有logger中最低的等级比较，再和这个logger自己的等级比较
+    // 如果满足条件返回cout上的一条新记录，自动加标签
+    // 否则返回一条不输出的空记录
+    static Record get_logger_when(Level level) {
+        return get_logger_when(level, get_logger_cout());
     }
 
-    // 如果满足条件返回指定名称的logger对象，自动加标签
-    // 否则返回MLogger单例__none__
-    static MLogger &get_logger_when(Level level,
-                                    const std::string &logger_name) {
-        return (MLogTool::get_level_instance() <= level)
-                   ? get_logger(logger_name).log_start(level)
-                   : get_logger_none();
+    // 如果满足条件返回指定名称的logger上的一条新记录，自动加标签
+    // 否则返回一条不输出的空记录
+    static Record get_logger_when(Level level, std::string_view logger_name) {
+        if (!MLOG_LEVEL_ENABLED(level)) return Record{nullptr};
+
+        MLogger &logger = get_logger(logger_name);
+        return logger.level_enabled(level) ? logger.log_start(level)
+                                           : Record{nullptr};
+    }
+
+    // 直接使用logger对象（例如保存下来的句柄），不需要查找
+    static Record get_logger_when(Level level, MLogger &logger) {
+        if (!MLOG_LEVEL_ENABLED(level)) return Record{nullptr};
+
+        return logger.level_enabled(level) ? logger.log_start(level)
+                                           : Record{nullptr};
     }
 
     //----------------------------------------------------------------------------//
@@ -90,12 +123,12 @@ public:
     // 创建cout和__none__两个默认logger对象，并完成相关设置然后锁定
     // 接收并记录一下日志文件的路径前缀
     static void init(const std::string &path_prefix) {
-        logger_map()["cout"]
+        get_logger_cout()
             .init_register("cout", true, OutType::C)
             .set_format(Format::LEVEL_COLOR)
             .lock();
 
-        logger_map()["__none__"]
+        get_logger_none()
             .init_register("__none__", false, OutType::C)
             .lock();
 
@@ -112,6 +145,19 @@ public:
         }
     }
 
+    // 启用异步模式，之后所有logger的输出都由后台线程写出
+    // 需要在init之后、开始写日志之前调用
+    static void init_async(std::size_t queue_capacity,
+                           MLogAsync::OverflowPolicy policy) {
+        MLogAsync::start(queue_capacity, policy,
+                         [](MLogAsync::Item &item) {
+                             item.logger->write_async_item(item);
+                         });
+    }
+
+    // 写出队列中剩余的记录并结束后台线程，之后恢复同步输出
+    static void shutdown_async() { MLogAsync::stop(); }
+
     // 在控制台展示当前的日志根目录，当前打开的所有日志文件
     static void show_detail() {
         get_logger_cout().log_start(Level::off) << " MLOG DETAIL\n";
@@ -119,7 +165,8 @@ public:
         get_logger_cout().log_start(Level::info)
             << " log file dir: " << MLogFileManager::get_path_prefix() << '\n';
 
-        // 遍历所有拥有文件流的logger
+        // 遍历所有拥有文件流的logger，期间不允许注册新的logger
+        std::lock_guard<std::mutex> lock(get_instance().m_register_mutex);
         auto iter = logger_map().begin();
         while (iter != logger_map().end()) {
             if (iter->second.m_logfile_ofstream) {
@@ -137,17 +184,137 @@ public:
 
 private:
     // 禁止从外部尝试构造，并且只允许static方法访问实例
-    MLoggerManager() = default;
-    ~MLoggerManager() = default;
+    // 确保异步后端、二进制日志的注册表和文件管理（包括滚动的后台线程）先于logger构造，
+    // 从而在所有logger析构之后才析构
+    MLoggerManager() {
+        MLogAsync::get_instance();
+        MLogBinary::prepare();
+        MLogFileManager::get_path_prefix();
 
-    // 获取唯一实例的map
-    static std::map<const std::string, MLogger> &logger_map() {
+        m_index_versions.push_back(
+            std::make_unique<LoggerIndex>(LoggerIndex::min_capacity));
+        m_index.store(m_index_versions.back().get(), std::memory_order_release);
+    }
+
+    // logger析构前结束后台线程，队列中剩余的记录在此之前写出
+    ~MLoggerManager() { MLogAsync::stop(); }
+
+    static MLoggerManager &get_instance() {
         static MLoggerManager the_logger_manager;
-        return the_logger_manager.m_logger_map;
+        return the_logger_manager;
+    }
+
+    using LoggerNode = std::map<const std::string, MLogger>::value_type;
+
+    // 名称到logger的哈希索引，开放寻址，只增加不删除
+    // 每个槽位只写入一次，读取不加锁：读到空位说明名称不存在（或者还没有发布）
+    // 负载不超过一半，查找总能遇到空位
+    class LoggerIndex {
+    public:
+        constexpr static std::size_t min_capacity = 64;
+
+        // capacity必须是2的幂
+        explicit LoggerIndex(std::size_t capacity)
+            : m_mask(capacity - 1),
+              m_slots(
+                  std::make_unique<std::atomic<LoggerNode *>[]>(capacity)) {}
+
+        MLogger *find(std::string_view name) const {
+            for (std::size_t i = slot_of(name);; ++i) {
+                LoggerNode *node =
+                    m_slots[i & m_mask].load(std::memory_order_acquire);
+                if (node == nullptr) return nullptr;
+                if (node->first == name) return &node->second;
+            }
+        }
+
+        // 调用者持有m_register_mutex，并且已经确认还有空间
+        void insert(LoggerNode &node) {
+            std::size_t i = slot_of(node.first);
+            while (m_slots[i & m_mask].load(std::memory_order_relaxed)
+                   != nullptr) {
+                ++i;
+            }
+            m_slots[i & m_mask].store(&node, std::memory_order_release);
+            ++m_size;
+        }
+
+        bool has_room() const { return (m_size + 1) * 2 <= capacity(); }
+
+        std::size_t capacity() const { return m_mask + 1; }
+
+        // 复制到容量翻倍的新索引
+        std::unique_ptr<LoggerIndex> grow() const {
+            auto bigger = std::make_unique<LoggerIndex>(capacity() * 2);
+            for (std::size_t i = 0; i < capacity(); ++i) {
+                LoggerNode *node = m_slots[i].load(std::memory_order_relaxed);
+                if (node != nullptr) bigger->insert(*node);
+            }
+            return bigger;
+        }
+
+    private:
+        static std::size_t slot_of(std::string_view name) {
+            return std::hash<std::string_view>{}(name);
+        }
+
+        const std::size_t m_mask;
+        std::size_t m_size{0};  // 只由持有m_register_mutex的线程访问
+        std::unique_ptr<std::atomic<LoggerNode *>[]> m_slots;
+    };
+
+    // 获取唯一实例的map，调用者持有m_register_mutex
+    static std::map<const std::string, MLogger> &logger_map() {
+        return get_instance().m_logger_map;
+    }
+
+    // 查找或者新建logger
+    static MLogger &logger_entry(const std::string &logger_name) {
+        auto &inst = get_instance();
+        std::lock_guard<std::mutex> lock(inst.m_register_mutex);
+        auto [iter, inserted] = inst.m_logger_map.try_emplace(logger_name);
+        if (inserted) inst.publish(*iter);
+        return iter->second;
+    }
+
+    // 新建并初始化logger，已经存在时返回nullptr
+    static MLogger *register_logger(const std::string &logger_name) {
+        auto &inst = get_instance();
+        std::lock_guard<std::mutex> lock(inst.m_register_mutex);
+        auto [iter, inserted] = inst.m_logger_map.try_emplace(logger_name);
+        if (!inserted) return nullptr;
+
+        iter->second.init_register(logger_name, true, OutType::C);
+        inst.publish(*iter);
+        return &iter->second;
+    }
+
+    // 直接写入当前索引的空位；空间不够时复制到容量翻倍的新索引，再整体替换
+    // 旧的索引可能仍然被其它线程读取，保留到析构时才释放
+    // 容量成倍增长，所有保留的索引加起来与logger数量成正比
+    // map中的节点不会移动，因此索引中的名称和指针一直有效
+    // 调用者持有m_register_mutex
+    void publish(LoggerNode &node) {
+        LoggerIndex &index = *m_index_versions.back();
+        if (index.has_room()) {
+            index.insert(node);
+            return;
+        }
+
+        auto bigger = index.grow();
+        bigger->insert(node);
+        m_index.store(bigger.get(), std::memory_order_release);
+        m_index_versions.push_back(std::move(bigger));
     }
 
     // 基于map存储logger，必须具名
     std::map<const std::string, MLogger> m_logger_map;
+    // 注册logger的互斥锁，查找不需要加锁
+    std::mutex m_register_mutex;
+    // 当前发布的索引，用于每条日志的查找
+    std::atomic<const LoggerIndex *> m_index{nullptr};
+    // 所有发布过的索引，最后一个是当前的索引
+    std::vector<std::unique_ptr<LoggerIndex>> m_index_versions;
 };
 
 #endif  // MLOGGERMANAGER_H_
@@ -0,0 +1,273 @@
+#ifndef MLOGINDEX_H_
+#define MLOGINDEX_H_
+
+#include "mlogtool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+// 日志文件的旁路索引，文件名为日志文件名加上.idx
+// 日志每写入interval字节，索引中追加一项：这一段的偏移和长度、时间范围、出现过的等级、logger的id
+// 读取时先加载索引，只读取时间范围有交集、或者包含指定等级的段，不需要扫描整个日志
+//
+// 索引文件：magic "MLIX" | 版本 u32 | 若干个Entry（按偏移递增）
+// 最后一项之后的内容（还没有写满一段的部分）不在索引中，读取时总是包含它
+class MLogIndex {
+public:
+    using Level = MLogTool::Level;
+    using TimePoint = std::chrono::system_clock::time_point;
+
+    constexpr static char magic[4] = {'M', 'L', 'I', 'X'};
+    constexpr static std::uint32_t version = 1;
+
+    struct Entry {
+        std::uint64_t offset{0};    // 这一段在日志文件中的起始位置
+        std::uint64_t size{0};      // 这一段的字节数
+        std::int64_t first_ns{0};   // 第一条记录的时间，Unix纪元以来的纳秒数
+        std::int64_t last_ns{0};    // 最后一条记录的时间
+        std::uint32_t levels{0};    // 出现过的等级，第i位对应Level的第i个值
+        std::uint32_t logger_id{0};  // logger名称的哈希值
+    };
+
+    // 日志文件中需要读取的一段，size为npos表示读到文件末尾
+    struct Range {
+        std::uint64_t offset{0};
+        std::uint64_t size{0};
+    };
+
+    constexpr static std::uint64_t npos = std::numeric_limits<std::uint64_t>::max();
+
+    MLogIndex() = default;
+
+    MLogIndex(const MLogIndex &) = delete;
+    MLogIndex &operator=(const MLogIndex &) = delete;
+
+    ~MLogIndex() { close(); }
+
+    static std::string index_path(const std::string &log_path) {
+        return log_path + ".idx";
+    }
+
+    static std::uint32_t level_bit(Level level) {
+        return 1U << static_cast<unsigned>(level);
+    }
+
+    // 不低于min_level的等级，on表示所有记录（包括logger自己的提示）
+    static std::uint32_t level_mask(Level min_level) {
+        if (min_level == Level::on) return ~0U;
+        return (level_bit(Level::off) - 1) & ~(level_bit(min_level) - 1);
+    }
+
+    static std::uint32_t logger_id(std::string_view name) {
+        std::uint32_t result = 2166136261U;
+        for (const char ch : name) {
+            result = (result ^ static_cast<std::uint8_t>(ch)) * 16777619U;
+        }
+        return result;
+    }
+
+    //----------------------------------------------------------------------------//
+    // 写入，由持有日志文件流的一方加锁
+
+    // 在日志文件打开之后、写入第一条记录之前调用，log_path是完整路径
+    // 追加模式下从日志文件当前的末尾继续，截断模式下索引也被截断
+    bool open(const std::string &log_path, std::string_view logger_name,
+              std::size_t interval, bool truncate) {
+        close();
+
+        std::error_code ec;
+        const std::string path = index_path(log_path);
+        m_offset = truncate ? 0 : std::filesystem::file_size(log_path, ec);
+        if (ec) m_offset = 0;
+        const bool empty = truncate || !std::filesystem::exists(path, ec)
+                           || std::filesystem::file_size(path, ec) == 0;
+
+        m_stream.open(path, std::ios_base::out | std::ios_base::binary // NOLINT(hicpp-signed-bitwise)
+                                | (truncate ? std::ios_base::trunc
+                                            : std::ios_base::app));
+        if (m_stream.fail()) return false;
+
+        if (empty) {
+            m_stream.write(static_cast<const char *>(magic), sizeof(magic));
+            write_value(m_stream, version);
+        }
+        m_interval = std::max<std::size_t>(interval, 1);
+        m_logger_id = logger_id(logger_name);
+        m_current = Entry{};
+        return true;
+    }
+
+    bool is_open() const { return m_stream.is_open(); }
+
+    // 一条记录已经写入日志文件
+    void add(std::size_t bytes, Level level) {
+        if (!m_stream.is_open() || bytes == 0) return;
+
+        const std::int64_t now =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch())
+                .count();
+        if (m_current.size == 0) {
+            m_current.offset = m_offset;
+            m_current.first_ns = now;
+            m_current.logger_id = m_logger_id;
+        }
+        m_current.last_ns = now;
+        m_current.levels |= level_bit(level);
+        m_current.size += bytes;
+        m_offset += bytes;
+
+        if (m_current.size >= m_interval) write_entry();
+    }
+
+    // 写出最后一段并关闭，之后整个日志文件都在索引中
+    void close() {
+        if (!m_stream.is_open()) return;
+
+        if (m_current.size > 0) write_entry();
+        m_stream.close();
+    }
+
+    //----------------------------------------------------------------------------//
+    // 读取
+
+    // 加载日志文件的索引，没有索引或者格式错误时返回false
+    // 末尾不完整的一项被忽略
+    static bool load(const std::string &log_path, std::vector<Entry> &entries) {
+        entries.clear();
+        std::ifstream fin(index_path(log_path), std::ios_base::binary);
+        char file_magic[sizeof(magic)]{};
+        std::uint32_t file_version = 0;
+        if (!fin.read(static_cast<char *>(file_magic), sizeof(file_magic))
+            || std::memcmp(file_magic, magic, sizeof(magic)) != 0
+            || !read_value(fin, file_version) || file_version != version) {
+            return false;
+        }
+
+        Entry entry;
+        while (read_value(fin, entry.offset) && read_value(fin, entry.size)
+               && read_value(fin, entry.first_ns) && read_value(fin, entry.last_ns)
+               && read_value(fin, entry.levels)
+               && read_value(fin, entry.logger_id)) {
+            entries.push_back(entry);
+        }
+        return true;
+    }
+
+    // 可能包含[from, to]之间、不低于min_level的记录的段，相邻的段合并为一段
+    // 索引之后的部分无法判断，总是包含在结果中
+    static std::vector<Range> select(const std::vector<Entry> &entries,
+                                     TimePoint from, TimePoint to,
+                                     Level min_level = Level::on) {
+        const std::int64_t begin_ns = to_ns(from);
+        const std::int64_t end_ns = to_ns(to);
+        const std::uint32_t mask = level_mask(min_level);
+
+        std::vector<Range> result;
+        const auto push = [&result](std::uint64_t offset, std::uint64_t size) {
+            if (!result.empty() && result.back().size != npos
+                && result.back().offset + result.back().size == offset) {
+                result.back().size = (size == npos) ? npos
+                                                    : result.back().size + size;
+                return;
+            }
+            result.push_back(Range{offset, size});
+        };
+
+        std::uint64_t end = 0;
+        for (const Entry &entry : entries) {
+            end = entry.offset + entry.size;
+            if (entry.last_ns < begin_ns || entry.first_ns > end_ns) continue;
+            if ((entry.levels & mask) == 0) continue;
+            push(entry.offset, entry.size);
+        }
+        push(end, npos);
+        return result;
+    }
+
+    // 全部时间范围，只按等级筛选
+    static std::vector<Range> select(const std::vector<Entry> &entries,
+                                     Level min_level) {
+        return select(entries, TimePoint::min(), TimePoint::max(), min_level);
+    }
+
+    // 把日志文件中的这些段依次写出，返回写出的字节数
+    static std::uint64_t copy(const std::string &log_path,
+                              const std::vector<Range> &ranges,
+                              std::ostream &out) {
+        std::ifstream fin(log_path, std::ios_base::binary);
+        std::uint64_t result = 0;
+        std::string buffer(std::size_t{1} << 16U, '\0');
+        for (const Range &range : ranges) {
+            fin.clear();
+            fin.seekg(static_cast<std::streamoff>(range.offset));
+            std::uint64_t left = range.size;
+            while (left > 0 && fin) {
+                const auto chunk = static_cast<std::streamsize>(
+                    std::min<std::uint64_t>(left, buffer.size()));
+                fin.read(buffer.data(), chunk);
+                const std::streamsize got = fin.gcount();
+                if (got <= 0) break;
+                out.write(buffer.data(), got);
+                result += static_cast<std::uint64_t>(got);
+                if (left != npos) left -= static_cast<std::uint64_t>(got);
+            }
+        }
+        return result;
+    }
+
+private:
+    static std::int64_t to_ns(TimePoint time) {
+        if (time == TimePoint::min()) return std::numeric_limits<std::int64_t>::min();
+        if (time == TimePoint::max()) return std::numeric_limits<std::int64_t>::max();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   time.time_since_epoch())
+            .count();
+    }
+
+    template <typename T>
+    static void write_value(std::ostream &out, T value) {
+        char bytes[sizeof(T)];
+        std::memcpy(static_cast<char *>(bytes), &value, sizeof(T));
+        out.write(static_cast<char *>(bytes), sizeof(T));
+    }
+
+    template <typename T>
+    static bool read_value(std::istream &in, T &value) {
+        char bytes[sizeof(T)];
+        if (!in.read(static_cast<char *>(bytes), sizeof(T))) return false;
+        std::memcpy(&value, static_cast<char *>(bytes), sizeof(T));
+        return true;
+    }
+
+    // 每一项写出后立即冲刷，崩溃时索引最多缺少最后一段
+    void write_entry() {
+        write_value(m_stream, m_current.offset);
+        write_value(m_stream, m_current.size);
+        write_value(m_stream, m_current.first_ns);
+        write_value(m_stream, m_current.last_ns);
+        write_value(m_stream, m_current.levels);
+        write_value(m_stream, m_current.logger_id);
+        m_stream.flush();
+        m_current = Entry{};
+    }
+
+    std::ofstream m_stream;
+    std::size_t m_interval{0};
+    std::uint64_t m_offset{0};  // 日志文件当前的长度
+    std::uint32_t m_logger_id{0};
+    Entry m_current;  // 正在累积的一段
+};
+
+#endif  // MLOGINDEX_H_
@@ -0,0 +1,119 @@
+#ifndef MLOGJSON_H_
+#define MLOGJSON_H_
+
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// 结构化日志字段的编码，直接追加到记录缓冲区，不经过ostream
+// 同一个字段既可以编码为JSON（"key":value），也可以编码为文本（key=value）
+class MLogJson {
+public:
+    MLogJson() = delete;
+
+    // 字段值可以是整数、浮点数、bool、字符串，其它类型由调用者转换为字符串
+    template <typename T>
+    constexpr static bool is_value =
+        std::is_arithmetic_v<std::remove_cvref_t<T>>
+        || std::is_convertible_v<const T &, std::string_view>;
+
+    // 追加一个带引号的JSON字符串，转义引号、反斜杠和控制字符
+    static void append_string(std::string &buffer, std::string_view str) {
+        constexpr static const char *hex = "0123456789abcdef";
+
+        buffer.push_back('"');
+        std::size_t start = 0;
+        for (std::size_t i = 0; i < str.size(); ++i) {
+            const auto ch = static_cast<unsigned char>(str[i]);
+            if (ch >= 0x20 && ch != '"' && ch != '\\') continue;
+
+            buffer.append(str.data() + start, i - start);
+            start = i + 1;
+            switch (ch) {
+            case '"': buffer.append("\\\""); break;
+            case '\\': buffer.append("\\\\"); break;
+            case '\n': buffer.append("\\n"); break;
+            case '\r': buffer.append("\\r"); break;
+            case '\t': buffer.append("\\t"); break;
+            case '\b': buffer.append("\\b"); break;
+            case '\f': buffer.append("\\f"); break;
+            default:
+                buffer.append("\\u00");
+                buffer.push_back(hex[ch >> 4U]);
+                buffer.push_back(hex[ch & 0xFU]);
+                break;
+            }
+        }
+        buffer.append(str.data() + start, str.size() - start);
+        buffer.push_back('"');
+    }
+
+    // 追加 ,"key":
+    static void append_key(std::string &buffer, std::string_view key) {
+        buffer.push_back(',');
+        append_string(buffer, key);
+        buffer.push_back(':');
+    }
+
+    // JSON值，非有限的浮点数写为null
+    template <typename T>
+        requires is_value<T>
+    static void append_json(std::string &buffer, const T &value) {
+        using U = std::remove_cvref_t<T>;
+        if constexpr (std::is_same_v<U, bool>) {
+            buffer.append(value ? "true" : "false");
+        }
+        else if constexpr (std::is_same_v<U, char>) {
+            append_string(buffer, std::string_view{&value, 1});
+        }
+        else if constexpr (std::is_floating_point_v<U>) {
+            if (std::isfinite(value)) { append_number(buffer, value); }
+            else { buffer.append("null"); }
+        }
+        else if constexpr (std::is_arithmetic_v<U>) {
+            append_number(buffer, value);
+        }
+        else {
+            append_string(buffer, std::string_view{value});
+        }
+    }
+
+    // 文本值，字符串原样输出
+    template <typename T>
+        requires is_value<T>
+    static void append_text(std::string &buffer, const T &value) {
+        using U = std::remove_cvref_t<T>;
+        if constexpr (std::is_same_v<U, bool>) {
+            buffer.append(value ? "true" : "false");
+        }
+        else if constexpr (std::is_same_v<U, char>) {
+            buffer.push_back(value);
+        }
+        else if constexpr (std::is_floating_point_v<U>) {
+            if (std::isfinite(value)) { append_number(buffer, value); }
+            else if (std::isnan(value)) { buffer.append("nan"); }
+            else { buffer.append(value > 0 ? "inf" : "-inf"); }
+        }
+        else if constexpr (std::is_arithmetic_v<U>) {
+            append_number(buffer, value);
+        }
+        else {
+            buffer.append(std::string_view{value});
+        }
+    }
+
+private:
+    // 最短的能够精确还原的表示，不受locale影响
+    template <typename T>
+    static void append_number(std::string &buffer, T value) {
+        char tmp[64];
+        const auto result =
+            std::to_chars(static_cast<char *>(tmp), tmp + sizeof(tmp), value);
+        buffer.append(static_cast<char *>(tmp), result.ptr);
+    }
+};
+
+#endif  // MLOGJSON_H_
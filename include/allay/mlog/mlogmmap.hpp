@@ -0,0 +1,256 @@
+#ifndef MLOGMMAP_H_
+#define MLOGMMAP_H_
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MLOG_HAS_MMAP
+#endif
+
+#ifdef MLOG_HAS_MMAP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// 基于mmap的日志文件
+// 文件按照固定大小的段预先分配并映射，写一条记录只需要原子地预定一段偏移，然后memcpy
+// 多个线程可以同时写入，只有第一次用到一个新段时才需要加锁映射
+// 一个段被完整写满后由最后写完的线程解除映射，关闭时把文件截断到实际长度
+// 进程崩溃时没有机会截断，文件末尾会留下当前段中没有写入的部分，全部是0字节
+// mlog_grep读取时忽略末尾的0字节，也可以用MLogMmapFile::recover把文件截断到实际内容
+class MLogMmapFile {
+public:
+    constexpr static std::size_t default_segment_size = 4U << 20U;  // 4 MiB
+
+    MLogMmapFile() = default;
+
+    MLogMmapFile(const MLogMmapFile &) = delete;
+    MLogMmapFile &operator=(const MLogMmapFile &) = delete;
+
+    ~MLogMmapFile() { close(); }
+
+    // 截断打开文件，段大小会向上取整为页大小的整数倍，0表示默认大小
+    bool open(const std::string &file_name, std::size_t segment_size = 0) {
+        close();
+        if (segment_size == 0) segment_size = default_segment_size;
+
+        m_fd = ::open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644); // NOLINT(hicpp-signed-bitwise)
+        if (m_fd < 0) return false;
+
+        const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        m_segment_size = (segment_size + page - 1) / page * page;
+        if (m_segment_size == 0) m_segment_size = page;
+        m_offset.store(0, std::memory_order_relaxed);
+        m_file_size = 0;
+        for (auto &slot : m_slots) {
+            slot.index.store(free_index, std::memory_order_relaxed);
+            slot.base = nullptr;
+            slot.committed.store(0, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    bool is_open() const { return m_fd >= 0; }
+
+    // 追加一段数据，可以被多个线程同时调用
+    // 跨越段边界的数据分成两次写入
+    void append(std::string_view data) {
+        if (data.empty() || m_fd < 0) return;
+
+        std::uint64_t offset =
+            m_offset.fetch_add(data.size(), std::memory_order_relaxed);
+        while (!data.empty()) {
+            const std::uint64_t index = offset / m_segment_size;
+            const auto pos = static_cast<std::size_t>(offset % m_segment_size);
+            const std::size_t len = std::min(data.size(), m_segment_size - pos);
+
+            Slot &slot = acquire_segment(index);
+            // 映射失败时丢弃这部分数据，但仍然计数，保证槽位能被释放
+            if (slot.base != nullptr) {
+                std::memcpy(slot.base + pos, data.data(), len);
+            }
+            commit(slot, len);
+
+            data.remove_prefix(len);
+            offset += len;
+        }
+    }
+
+    // 请求把已经写入的内容写回磁盘，不等待完成
+    void flush() {
+        if (m_fd < 0) return;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &slot : m_slots) {
+            if (slot.index.load(std::memory_order_acquire) != free_index
+                && slot.base != nullptr) {
+                ::msync(slot.base, m_segment_size, MS_ASYNC);
+            }
+        }
+    }
+
+    // 解除所有映射，并把文件截断到实际写入的长度
+    // 调用时不能有其它线程正在写入
+    void close() {
+        if (m_fd < 0) return;
+
+        for (auto &slot : m_slots) {
+            if (slot.index.load(std::memory_order_acquire) != free_index
+                && slot.base != nullptr) {
+                ::munmap(slot.base, m_segment_size);
+            }
+            slot.index.store(free_index, std::memory_order_release);
+        }
+        static_cast<void>(::ftruncate(
+            m_fd, static_cast<off_t>(m_offset.load(std::memory_order_acquire))));
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    // 崩溃之后恢复文件：截断到最后一个非0字节之后，不能用于正在写入的文件
+    static bool recover(const std::string &file_name) {
+        const int fd = ::open(file_name.c_str(), O_RDWR); // NOLINT(hicpp-signed-bitwise)
+        if (fd < 0) return false;
+
+        // 从末尾向前逐块查找
+        char buffer[4096];
+        off_t end = ::lseek(fd, 0, SEEK_END);
+        while (end > 0) {
+            const off_t begin =
+                std::max<off_t>(end - static_cast<off_t>(sizeof(buffer)), 0);
+            const auto len = static_cast<std::size_t>(end - begin);
+            if (::pread(fd, static_cast<char *>(buffer), len, begin)
+                != static_cast<ssize_t>(len)) {
+                ::close(fd);
+                return false;
+            }
+            std::size_t kept = len;
+            while (kept > 0 && buffer[kept - 1] == '\0') --kept;
+            end = begin + static_cast<off_t>(kept);
+            if (kept > 0) break;
+        }
+
+        const bool ok = end >= 0 && ::ftruncate(fd, end) == 0;
+        ::close(fd);
+        return ok;
+    }
+
+private:
+    constexpr static std::size_t slot_num = 8;
+    constexpr static std::uint64_t free_index =
+        std::numeric_limits<std::uint64_t>::max();
+
+    // 第index段映射在m_slots[index % slot_num]中
+    // index在映射完成之后才写入，因此读到正确的index时base一定有效
+    struct Slot {
+        std::atomic<std::uint64_t> index{free_index};
+        char *base{nullptr};
+        std::atomic<std::size_t> committed{0};  // 已经写完的字节数
+    };
+
+    Slot &acquire_segment(std::uint64_t index) {
+        Slot &slot = m_slots[index % slot_num];
+        if (slot.index.load(std::memory_order_acquire) == index) return slot;
+
+        // 槽位还被更早的段占用时，在锁外等待那个段写完并释放槽位
+        for (;;) {
+            std::uint64_t current = free_index;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                current = slot.index.load(std::memory_order_acquire);
+                if (current == index) return slot;
+                if (current == free_index) {
+                    map_segment(slot, index);
+                    return slot;
+                }
+            }
+            slot.index.wait(current, std::memory_order_acquire);
+        }
+    }
+
+    // 持有m_mutex时调用，先扩展文件再映射
+    void map_segment(Slot &slot, std::uint64_t index) {
+        const std::uint64_t end = (index + 1) * m_segment_size;
+        if (end > m_file_size) {
+#if defined(__APPLE__)
+            const int result = -1;
+#else
+            const int result = ::posix_fallocate(
+                m_fd, static_cast<off_t>(m_file_size),
+                static_cast<off_t>(end - m_file_size));
+#endif
+            if (result != 0) {
+                static_cast<void>(::ftruncate(m_fd, static_cast<off_t>(end)));
+            }
+            m_file_size = end;
+        }
+
+        void *base = ::mmap(nullptr, m_segment_size, PROT_READ | PROT_WRITE, // NOLINT(hicpp-signed-bitwise)
+                            MAP_SHARED, m_fd,
+                            static_cast<off_t>(index * m_segment_size));
+        if (base == MAP_FAILED) { base = nullptr; }
+
+        slot.base = static_cast<char *>(base);
+        slot.committed.store(0, std::memory_order_relaxed);
+        slot.index.store(index, std::memory_order_release);
+    }
+
+    // 一个段全部写完后解除映射并释放槽位
+    // 持有m_mutex，避免flush同时对这段映射（或者重新映射到同一地址的下一个段）调用msync
+    void commit(Slot &slot, std::size_t len) {
+        const std::size_t done =
+            slot.committed.fetch_add(len, std::memory_order_acq_rel) + len;
+        if (done != m_segment_size) return;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (slot.base != nullptr) ::munmap(slot.base, m_segment_size);
+        slot.base = nullptr;
+        slot.index.store(free_index, std::memory_order_release);
+        slot.index.notify_all();  // 唤醒等待这个槽位的下一个段
+    }
+
+    int m_fd{-1};
+    std::size_t m_segment_size{default_segment_size};
+    alignas(64) std::atomic<std::uint64_t> m_offset{0};  // 下一个可以预定的偏移
+    std::uint64_t m_file_size{0};  // 已经分配的文件长度，由m_mutex保护
+    std::mutex m_mutex;  // 映射、解除映射和flush时使用，每个段只加锁两次
+    Slot m_slots[slot_num];
+};
+
+#else
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// 不支持mmap的平台上只保留接口，open总是失败
+class MLogMmapFile {
+public:
+    bool open(const std::string & /*file_name*/,
+              std::size_t /*segment_size*/ = 0) {
+        return false;
+    }
+
+    bool is_open() const { return false; }
+
+    static bool recover(const std::string & /*file_name*/) { return false; }
+
+    void append(std::string_view /*data*/) {}
+
+    void flush() {}
+
+    void close() {}
+};
+
+#endif  // MLOG_HAS_MMAP
+
+#endif  // MLOGMMAP_H_
@@ -0,0 +1,349 @@
+#ifndef MLOGPATTERN_H_
+#define MLOGPATTERN_H_
+
+#include "mlogtool.hpp"
+
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+// 记录开头的格式模板，类似spdlog，例如
+// "%Y-%m-%d %H:%M:%S.%e [%l] {%n} %t %v"
+// 模板只在设置时编译一次，得到一个扁平的步骤列表，每条记录依次执行这些步骤
+//
+// %Y %m %d %H %M %S 年月日时分秒    %T 等价于%H:%M:%S
+// %e %f %F 毫秒、微秒、纳秒          %l 等级，例如INFO    %L 等级的首字母
+// %n logger名称                    %t 线程id            %P 进程id
+// %s 文件名:行号                    %g 完整路径:行号      %# 行号    %! 函数名
+// %^ 着色开始（只能位于开头）        %$ 着色结束          %% 字符%
+// %v 正文开始的位置，之后的内容被忽略；没有%v时正文紧跟在模板之后
+// 调用点信息只有MLOG_*宏的记录才有，在提交时填入
+class MLogPattern {
+public:
+    using Level = MLogTool::Level;
+
+    // 调用点信息在记录中的位置和种类
+    enum class SiteField : std::uint8_t {
+        FILE_LINE = 0,  // 文件名:行号
+        PATH_LINE,      // 完整路径:行号
+        LINE,
+        FUNCTION,
+    };
+
+    struct SiteSlot {
+        std::size_t pos{0};
+        SiteField field{SiteField::FILE_LINE};
+    };
+
+    constexpr static std::size_t max_site_slots = 4;
+
+    // 执行步骤时的上下文，时间只在模板用到时取一次
+    struct Context {
+        Level level{Level::on};
+        std::string_view name;
+        const MLogTool::TimeCache *time{nullptr};
+        std::uint32_t frac_ns{0};
+        std::array<SiteSlot, max_site_slots> *slots{nullptr};
+        std::size_t *slot_count{nullptr};
+        std::size_t color_len{0};  // %$的位置，0表示不着色
+    };
+
+    MLogPattern() = default;
+
+    explicit MLogPattern(std::string_view pattern) { compile(pattern); }
+
+    bool empty() const { return m_steps.empty(); }
+
+    const std::string &pattern() const { return m_pattern; }
+
+    bool colored() const { return m_colored; }
+
+    // 把模板编译为步骤列表，未知的标记按原样输出
+    void compile(std::string_view pattern) {
+        m_pattern = pattern;
+        m_literals.clear();
+        m_steps.clear();
+        m_needs_time = false;
+        m_colored = false;
+
+        std::string literal;
+        const auto flush_literal = [this, &literal]() {
+            if (literal.empty()) return;
+            m_steps.push_back(Step{append_literal, m_literals.size(),
+                                   literal.size()});
+            m_literals.append(literal);
+            literal.clear();
+        };
+
+        for (std::size_t i = 0; i < pattern.size(); ++i) {
+            if (pattern[i] != '%' || i + 1 == pattern.size()) {
+                literal.push_back(pattern[i]);
+                continue;
+            }
+
+            const char flag = pattern[++i];
+            if (flag == 'v') break;
+            if (flag == '%') {
+                literal.push_back('%');
+                continue;
+            }
+            if (flag == '^') {
+                m_colored = m_steps.empty() && literal.empty();
+                continue;
+            }
+
+            const StepFn fn = step_of(flag);
+            if (fn == nullptr) {
+                literal.push_back('%');
+                literal.push_back(flag);
+                continue;
+            }
+            flush_literal();
+            m_steps.push_back(Step{fn, 0, 0});
+            m_needs_time = m_needs_time || is_time_flag(flag);
+        }
+        flush_literal();
+
+        // 空模板也需要一个步骤，区分于未设置
+        if (m_steps.empty()) m_steps.push_back(Step{append_literal, 0, 0});
+    }
+
+    // 依次执行所有步骤，追加到out末尾
+    void format(std::string &out, Context &ctx) const {
+        if (m_needs_time) {
+            const auto now = std::chrono::system_clock::now();
+            const auto now_s = std::chrono::floor<std::chrono::seconds>(now);
+            ctx.time = &MLogTool::time_cache(
+                std::chrono::system_clock::to_time_t(now_s));
+            ctx.frac_ns = static_cast<std::uint32_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - now_s)
+                    .count());
+        }
+        for (const Step &step : m_steps) {
+            step.fn(out, ctx,
+                    std::string_view{m_literals}.substr(step.offset, step.len));
+        }
+    }
+
+    // 把调用点信息填入记录中预留的位置，从后往前插入，前面的位置不受影响
+    // 着色的长度随着插入的内容增加
+    static void render_site(std::string &out, const MLogSite &site,
+                            const std::array<SiteSlot, max_site_slots> &slots,
+                            std::size_t slot_count, std::size_t &color_len) {
+        thread_local std::string tmp;
+        for (std::size_t i = slot_count; i-- > 0;) {
+            tmp.clear();
+            switch (slots[i].field) {
+            case SiteField::FILE_LINE:
+                tmp.append(base_name(site.file)).push_back(':');
+                append_number(tmp, site.line);
+                break;
+            case SiteField::PATH_LINE:
+                tmp.append(site.file).push_back(':');
+                append_number(tmp, site.line);
+                break;
+            case SiteField::LINE: append_number(tmp, site.line); break;
+            case SiteField::FUNCTION: tmp.append(site.function); break;
+            }
+            out.insert(slots[i].pos, tmp);
+            if (slots[i].pos < color_len) color_len += tmp.size();
+        }
+    }
+
+private:
+    using StepFn = void (*)(std::string &, Context &, std::string_view);
+
+    struct Step {
+        StepFn fn;
+        std::size_t offset;  // 字面量在m_literals中的位置
+        std::size_t len;
+    };
+
+    static bool is_time_flag(char flag) {
+        return std::string_view{"YmdHMSTefF"}.find(flag)
+               != std::string_view::npos;
+    }
+
+    static StepFn step_of(char flag) {
+        switch (flag) {
+        case 'Y': return [](std::string &out, Context &ctx, std::string_view) {
+            append_digits(out, ctx.time->timeinfo.tm_year + 1900, 4);
+        };
+        case 'm': return [](std::string &out, Context &ctx, std::string_view) {
+            append_digits(out, ctx.time->timeinfo.tm_mon + 1, 2);
+        };
+        case 'd': return [](std::string &out, Context &ctx, std::string_view) {
+            append_digits(out, ctx.time->timeinfo.tm_mday, 2);
+        };
+        case 'H': return [](std::string &out, Context &ctx, std::string_view) {
+            append_digits(out, ctx.time->timeinfo.tm_hour, 2);
+        };
+        case 'M': return [](std::string &out, Context &ctx, std::string_view) {
+            append_digits(out, ctx.time->timeinfo.tm_min, 2);
+        };
+        case 'S': return [](std::string &out, Context &ctx, std::string_view) {
+            append_digits(out, ctx.time->timeinfo.tm_sec, 2);
+        };
+        case 'T': return [](std::string &out, Context &ctx, std::string_view) {
+            // 缓存中的时间戳形如[2016-06-21 20:54:11
+            out.append(static_cast<const char *>(ctx.time->stamp) + 12, 8);
+        };
+        case 'e': return [](std::string &out, Context &ctx, std::string_view) {
+            append_digits(out, static_cast<int>(ctx.frac_ns / 1000000), 3);
+        };
+        case 'f': return [](std::string &out, Context &ctx, std::string_view) {
+            append_digits(out, static_cast<int>(ctx.frac_ns / 1000), 6);
+        };
+        case 'F': return [](std::string &out, Context &ctx, std::string_view) {
+            append_digits(out, static_cast<int>(ctx.frac_ns), 9);
+        };
+        case 'l': return [](std::string &out, Context &ctx, std::string_view) {
+            out.append(level_name(ctx.level));
+        };
+        case 'L': return [](std::string &out, Context &ctx, std::string_view) {
+            out.push_back(level_name(ctx.level).front());
+        };
+        case 'n': return [](std::string &out, Context &ctx, std::string_view) {
+            out.append(ctx.name);
+        };
+        case 't': return [](std::string &out, Context &, std::string_view) {
+            out.append(thread_id());
+        };
+        case 'P': return [](std::string &out, Context &, std::string_view) {
+            out.append(process_id());
+        };
+        case 's': return site_step<SiteField::FILE_LINE>;
+        case 'g': return site_step<SiteField::PATH_LINE>;
+        case '#': return site_step<SiteField::LINE>;
+        case '!': return site_step<SiteField::FUNCTION>;
+        case '$': return [](std::string &out, Context &ctx, std::string_view) {
+            ctx.color_len = out.size();
+        };
+        default: return nullptr;
+        }
+    }
+
+    static void append_literal(std::string &out, Context & /*ctx*/,
+                               std::string_view literal) {
+        out.append(literal);
+    }
+
+    // 只记录位置，调用点信息在提交时填入
+    template <SiteField Field>
+    static void site_step(std::string &out, Context &ctx, std::string_view) {
+        if (ctx.slots == nullptr || *ctx.slot_count == max_site_slots) return;
+        (*ctx.slots)[(*ctx.slot_count)++] = SiteSlot{out.size(), Field};
+    }
+
+    static std::string_view level_name(Level level) {
+        switch (level) {
+        case Level::debug: return "DEBUG";
+        case Level::info: return "INFO";
+        case Level::warn: return "WARN";
+        case Level::error: return "ERROR";
+        case Level::on:
+        case Level::off:
+        default: return "MLOG";
+        }
+    }
+
+    static void append_digits(std::string &out, int value, std::size_t width) {
+        char buffer[16];
+        const std::size_t len = MLogTool::write_digits(
+            static_cast<char *>(buffer), static_cast<std::uint32_t>(value),
+            width);
+        out.append(static_cast<char *>(buffer), len);
+    }
+
+    static void append_number(std::string &out, std::uint_least32_t value) {
+        char buffer[16];
+        const auto result = std::to_chars(static_cast<char *>(buffer),
+                                          static_cast<char *>(buffer) + 16, value);
+        out.append(static_cast<char *>(buffer), result.ptr);
+    }
+
+    static std::string_view base_name(std::string_view path) {
+        const std::size_t pos = path.find_last_of("/\\");
+        return pos == std::string_view::npos ? path : path.substr(pos + 1);
+    }
+
+    // fork之后子进程的进程id和线程id都会改变，子进程中这个代数加一，缓存随之失效
+    static std::atomic<unsigned> &fork_generation() {
+        static std::atomic<unsigned> the_generation{0};
+#if !defined(_WIN32)
+        static const bool the_registered = []() {
+            ::pthread_atfork(nullptr, nullptr, []() {
+                the_generation.fetch_add(1, std::memory_order_relaxed);
+            });
+            return true;
+        }();
+        static_cast<void>(the_registered);
+#endif
+        return the_generation;
+    }
+
+    // 线程id和进程id在每个线程中只格式化一次，fork之后重新格式化
+    struct IdCache {
+        unsigned generation{~0U};
+        std::string text;
+    };
+
+    static const std::string &thread_id() {
+        thread_local IdCache the_cache;
+        const unsigned generation =
+            fork_generation().load(std::memory_order_relaxed);
+        if (the_cache.generation != generation) {
+#if defined(__linux__)
+            the_cache.text = std::to_string(::syscall(SYS_gettid));
+#else
+            the_cache.text = std::to_string(
+                std::hash<std::thread::id>{}(std::this_thread::get_id()));
+#endif
+            the_cache.generation = generation;
+        }
+        return the_cache.text;
+    }
+
+    static const std::string &process_id() {
+        thread_local IdCache the_cache;
+        const unsigned generation =
+            fork_generation().load(std::memory_order_relaxed);
+        if (the_cache.generation != generation) {
+#if defined(_WIN32)
+            the_cache.text = std::to_string(::_getpid());
+#else
+            the_cache.text = std::to_string(::getpid());
+#endif
+            the_cache.generation = generation;
+        }
+        return the_cache.text;
+    }
+
+    std::string m_pattern;
+    std::string m_literals;  // 所有字面量连续存放
+    std::vector<Step> m_steps;
+    bool m_needs_time{false};
+    bool m_colored{false};
+};
+
+#endif  // MLOGPATTERN_H_
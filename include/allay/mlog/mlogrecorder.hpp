@@ -0,0 +1,307 @@
+#ifndef MLOGRECORDER_H_
+#define MLOGRECORDER_H_
+
+#include "mlogsink.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MLOG_HAS_SIGACTION
+#endif
+
+#ifdef MLOG_HAS_SIGACTION
+#include <csignal>
+#include <fcntl.h>
+#include <signal.h>  // NOLINT(modernize-deprecated-headers)
+#include <unistd.h>
+#else
+#include <csignal>
+#include <cstdio>
+#endif
+
+// 飞行记录器：在预先分配的环形缓冲区中保留最近的记录，平时不做任何磁盘IO
+// 只保留最近max_bytes字节，max_records大于0时还最多保留最近max_records条
+// 通常把它的等级设为debug，而其它输出保持info，崩溃时就能得到完整的上下文
+class MLogRingSink : public MLogSink {
+public:
+    explicit MLogRingSink(std::size_t max_bytes, std::size_t max_records = 0)
+        : m_capacity(std::max<std::size_t>(max_bytes, 1)),
+          m_data(std::make_unique<char[]>(m_capacity)),
+          m_max_records(max_records),
+          m_starts(max_records > 0
+                       ? std::make_unique<std::uint64_t[]>(max_records)
+                       : nullptr) {}
+
+    // 只做内存拷贝，超过容量的单条记录只保留末尾部分
+    void write(const MLogRecordView &record) override {
+        std::string_view text = payload(record);
+        if (text.empty()) return;
+
+        lock(false);
+        if (m_max_records > 0) m_starts[m_count % m_max_records] = m_total;
+        ++m_count;
+        if (text.size() > m_capacity) {
+            m_total += text.size() - m_capacity;
+            text.remove_prefix(text.size() - m_capacity);
+        }
+
+        const auto pos = static_cast<std::size_t>(m_total % m_capacity);
+        const std::size_t first = std::min(text.size(), m_capacity - pos);
+        std::copy_n(text.data(), first, m_data.get() + pos);
+        std::copy_n(text.data() + first, text.size() - first, m_data.get());
+        m_total += text.size();
+        unlock();
+    }
+
+    // 当前保留的内容，按照写入顺序
+    std::string recent() const {
+        std::string result;
+        visit(
+            [&result](const char *data, std::size_t len) {
+                result.append(data, len);
+            },
+            false);
+        return result;
+    }
+
+    // 把保留的内容写入文件（截断），可以在信号处理函数中调用
+    // crashing为true时不会无限等待其它线程释放缓冲区
+    bool dump(const char *path, bool crashing = false) const {
+#ifdef MLOG_HAS_SIGACTION
+        const int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644); // NOLINT(hicpp-signed-bitwise)
+        if (fd < 0) return false;
+
+        bool ok = true;
+        visit(
+            [fd, &ok](const char *data, std::size_t len) {
+                while (ok && len > 0) {
+                    const ::ssize_t n = ::write(fd, data, len);
+                    if (n <= 0) {
+                        ok = false;
+                        break;
+                    }
+                    data += n;
+                    len -= static_cast<std::size_t>(n);
+                }
+            },
+            crashing);
+        return (::close(fd) == 0) && ok;
+#else
+        std::FILE *file = std::fopen(path, "wb");
+        if (file == nullptr) return false;
+
+        bool ok = true;
+        visit(
+            [file, &ok](const char *data, std::size_t len) {
+                ok = (std::fwrite(data, 1, len, file) == len) && ok;
+            },
+            crashing);
+        return (std::fclose(file) == 0) && ok;
+#endif
+    }
+
+private:
+    // 崩溃时最多等待的次数，持有锁的线程可能已经不会再运行
+    constexpr static int crash_spin_limit = 1 << 16;
+
+    void lock(bool crashing) const {
+        for (int i = 0; m_lock.test_and_set(std::memory_order_acquire); ++i) {
+            if (crashing && i >= crash_spin_limit) return;
+            std::this_thread::yield();
+        }
+    }
+
+    void unlock() const { m_lock.clear(std::memory_order_release); }
+
+    // 按顺序对保留的内容调用fn(data, len)，至多两段
+    // 只按字节截断时，开头可能是半条记录，跳到第一个换行之后
+    template <typename Fn>
+    void visit(Fn fn, bool crashing) const {
+        lock(crashing);
+        std::uint64_t begin = m_total > m_capacity ? m_total - m_capacity : 0;
+        bool cut = begin > 0;
+        if (m_max_records > 0 && m_count > m_max_records) {
+            const std::uint64_t start = m_starts[m_count % m_max_records];
+            if (start >= begin) {
+                begin = start;
+                cut = false;
+            }
+        }
+        if (cut) {
+            std::uint64_t pos = begin;
+            while (pos < m_total && m_data[pos % m_capacity] != '\n') ++pos;
+            if (pos + 1 < m_total) begin = pos + 1;
+        }
+
+        const auto first = static_cast<std::size_t>(begin % m_capacity);
+        const auto len = static_cast<std::size_t>(m_total - begin);
+        const std::size_t head = std::min(len, m_capacity - first);
+        fn(m_data.get() + first, head);
+        if (len > head) fn(m_data.get(), len - head);
+        unlock();
+    }
+
+    const std::size_t m_capacity;
+    std::unique_ptr<char[]> m_data;
+    const std::size_t m_max_records;
+    std::unique_ptr<std::uint64_t[]> m_starts;  // 最近max_records条记录的起始位置
+
+    std::uint64_t m_total{0};  // 累计写入的字节数，对容量取模就是写入位置
+    std::uint64_t m_count{0};  // 累计写入的记录数
+    mutable std::atomic_flag m_lock;
+};
+
+// 飞行记录器的注册表，单例
+// 第一次注册时安装致命信号和std::terminate的处理函数，崩溃时把所有记录器写入各自的文件
+// 也可以通过dump随时写出，例如 mlog::dump_recent()
+class MLogRecorder {
+public:
+    constexpr static std::size_t max_recorders = 16;
+
+    MLogRecorder(const MLogRecorder &) = delete;
+    MLogRecorder &operator=(const MLogRecorder &) = delete;
+
+    // file_name不含路径前缀，注册时就确定完整路径，崩溃时不再分配内存
+    // 超过max_recorders时返回false，可以在多个线程中同时注册
+    static bool add(std::shared_ptr<MLogRingSink> sink,
+                    const std::string &file_name) {
+        auto &inst = get_instance();
+        std::lock_guard<std::mutex> lock(inst.m_add_mutex);
+        const std::size_t index = inst.m_size.load(std::memory_order_relaxed);
+        if (sink == nullptr || index == max_recorders) return false;
+
+        inst.m_entries[index].sink = std::move(sink);
+        inst.m_entries[index].path =
+            MLogFileManager::get_path_prefix() + file_name;
+        inst.m_size.store(index + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 写出所有记录器，返回成功写出的个数
+    static std::size_t dump() { return get_instance().dump_all(false); }
+
+    static MLogRecorder &get_instance() {
+        static MLogRecorder the_recorder;
+        return the_recorder;
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<MLogRingSink> sink;
+        std::string path;
+    };
+
+#ifdef MLOG_HAS_SIGACTION
+    constexpr static std::array<int, 5> fatal_signals{SIGSEGV, SIGBUS, SIGFPE,
+                                                      SIGILL, SIGABRT};
+#else
+    constexpr static std::array<int, 4> fatal_signals{SIGSEGV, SIGFPE, SIGILL,
+                                                      SIGABRT};
+#endif
+
+    MLogRecorder() {
+        for (std::size_t i = 0; i < fatal_signals.size(); ++i) {
+#ifdef MLOG_HAS_SIGACTION
+            struct sigaction action {};
+            action.sa_handler = on_signal;
+            sigemptyset(&action.sa_mask);
+            ::sigaction(fatal_signals[i], &action, &m_old_actions[i]);
+#else
+            m_old_actions[i] = std::signal(fatal_signals[i], on_signal);
+#endif
+        }
+        m_old_terminate = std::set_terminate(on_terminate);
+        active().store(this, std::memory_order_release);
+    }
+
+    // 析构之后信号处理函数不再访问注册表，并恢复原来的处理函数
+    ~MLogRecorder() {
+        active().store(nullptr, std::memory_order_release);
+        std::set_terminate(m_old_terminate);
+        for (std::size_t i = 0; i < fatal_signals.size(); ++i) {
+#ifdef MLOG_HAS_SIGACTION
+            ::sigaction(fatal_signals[i], &m_old_actions[i], nullptr);
+#else
+            std::signal(fatal_signals[i], m_old_actions[i]);
+#endif
+        }
+    }
+
+    // 常量初始化的局部静态变量，不会被析构，信号处理函数可以安全地读取
+    static std::atomic<MLogRecorder *> &active() {
+        static std::atomic<MLogRecorder *> the_active_recorder{nullptr};
+        return the_active_recorder;
+    }
+
+    std::size_t dump_all(bool crashing) const {
+        std::size_t result = 0;
+        const std::size_t size = m_size.load(std::memory_order_acquire);
+        for (std::size_t i = 0; i < size; ++i) {
+            if (m_entries[i].sink->dump(m_entries[i].path.c_str(), crashing)) {
+                ++result;
+            }
+        }
+        return result;
+    }
+
+    // 崩溃时只写出一次，std::terminate之后的abort不会再写一遍
+    static void dump_on_crash() {
+        MLogRecorder *inst = active().load(std::memory_order_acquire);
+        if (inst == nullptr || inst->m_crashed.exchange(true)) return;
+
+        inst->dump_all(true);
+    }
+
+    // 写出之后恢复原来的处理方式，重新触发同一个信号
+    static void on_signal(int sig) {
+        dump_on_crash();
+
+        MLogRecorder *inst = active().load(std::memory_order_acquire);
+        for (std::size_t i = 0; inst != nullptr && i < fatal_signals.size();
+             ++i) {
+            if (fatal_signals[i] != sig) continue;
+#ifdef MLOG_HAS_SIGACTION
+            ::sigaction(sig, &inst->m_old_actions[i], nullptr);
+#else
+            std::signal(sig, inst->m_old_actions[i]);
+#endif
+        }
+        if (inst == nullptr) std::signal(sig, SIG_DFL);
+        std::raise(sig);
+    }
+
+    [[noreturn]] static void on_terminate() {
+        dump_on_crash();
+
+        MLogRecorder *inst = active().load(std::memory_order_acquire);
+        if (inst != nullptr && inst->m_old_terminate != nullptr) {
+            inst->m_old_terminate();
+        }
+        std::abort();
+    }
+
+    std::array<Entry, max_recorders> m_entries;
+    std::mutex m_add_mutex;  // 注册时填写一项再发布，信号处理函数只读取m_size，不加锁
+    std::atomic<std::size_t> m_size{0};
+    std::atomic<bool> m_crashed{false};
+
+#ifdef MLOG_HAS_SIGACTION
+    std::array<struct sigaction, fatal_signals.size()> m_old_actions{};
+#else
+    std::array<void (*)(int), fatal_signals.size()> m_old_actions{};
+#endif
+    std::terminate_handler m_old_terminate{nullptr};
+};
+
+#endif  // MLOGRECORDER_H_
@@ -0,0 +1,193 @@
+#ifndef MLOGSINK_H_
+#define MLOGSINK_H_
+
+#include "mlogtool.hpp"
+
+#include "mlogfilemanager.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// 一条已经格式化好的记录，所有sink看到的是同一份字节
+struct MLogRecordView {
+    std::string_view text;
+    MLogTool::Level level{MLogTool::Level::on};
+    const char *color{nullptr};  // 开头color_len个字符在终端上着色
+    std::size_t color_len{0};
+    bool flush{false};  // std::endl或者std::flush要求立即冲刷
+    std::string_view json{};  // JSON编码的同一条记录，只有JSON模式的logger才有
+};
+
+// 日志的输出目标，一个logger可以同时输出到任意多个sink
+// write可能被多个线程同时调用（异步模式下只有后台线程调用），需要自己保证线程安全
+// 新的输出方式只需要继承MLogSink，不需要修改MLogger
+class MLogSink {
+public:
+    using Level = MLogTool::Level;
+    using Encoding = MLogTool::Encoding;
+
+    MLogSink() = default;
+
+    MLogSink(const MLogSink &) = delete;
+    MLogSink &operator=(const MLogSink &) = delete;
+
+    virtual ~MLogSink() = default;
+
+    virtual void write(const MLogRecordView &record) = 0;
+
+    virtual void flush() {}
+
+    // sink自己的最低等级，logger的等级过滤之后再过滤一次
+    void set_level(Level level) {
+        m_level.store(level, std::memory_order_relaxed);
+    }
+
+    bool accepts(Level level) const {
+        return m_level.load(std::memory_order_relaxed) <= level;
+    }
+
+    // 选择JSON时写入记录的JSON编码，记录没有JSON编码时仍然写入文本
+    // 只在添加到logger之前设置
+    void set_encoding(Encoding encoding) { m_encoding = encoding; }
+
+protected:
+    std::string_view payload(const MLogRecordView &record) const {
+        if (m_encoding == Encoding::JSON && !record.json.empty()) {
+            return record.json;
+        }
+        return record.text;
+    }
+
+private:
+    std::atomic<Level> m_level{Level::on};
+    Encoding m_encoding{Encoding::TEXT};
+};
+
+// 输出到cout，按照记录的颜色着色，总是写入文本
+class MLogConsoleSink : public MLogSink {
+public:
+    void write(const MLogRecordView &record) override {
+        std::lock_guard<std::mutex> lock(MLogTool::console_mutex());
+        write_colored(std::cout, record);
+    }
+
+    void flush() override {
+        std::lock_guard<std::mutex> lock(MLogTool::console_mutex());
+        std::cout.flush();
+    }
+
+    // 调用者负责加锁
+    static void write_colored(std::ostream &os, const MLogRecordView &record) {
+        const std::string_view text = record.text;
+        if (record.color != nullptr && record.color_len > 0) {
+            os << record.color;
+            os.write(text.data(),
+                     static_cast<std::streamsize>(record.color_len));
+            os << MLogTool::ansi_color_end;
+            os.write(text.data() + record.color_len,
+                     static_cast<std::streamsize>(text.size()
+                                                  - record.color_len));
+        }
+        else {
+            os.write(text.data(), static_cast<std::streamsize>(text.size()));
+        }
+        if (record.flush) os.flush();
+    }
+};
+
+// 输出到一个外部的ostream，不着色，调用者保证ostream的生命周期
+class MLogStreamSink : public MLogSink {
+public:
+    explicit MLogStreamSink(std::ostream &os) : m_os(os) {}
+
+    void write(const MLogRecordView &record) override {
+        const std::string_view text = payload(record);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_os.write(text.data(), static_cast<std::streamsize>(text.size()));
+        if (record.flush) m_os.flush();
+    }
+
+    void flush() override {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_os.flush();
+    }
+
+private:
+    std::ostream &m_os;
+    std::mutex m_mutex;
+};
+
+// 输出到日志文件，文件名不含路径前缀，并且和logger的日志文件一样不能重复
+// 可以指定滚动策略，滚动的方式与MLogger::link_file_rotating相同
+class MLogFileSink : public MLogSink {
+public:
+    using RotatePolicy = MLogFileManager::RotatePolicy;
+
+    explicit MLogFileSink(const std::string &file_name, bool truncate = false)
+        : m_file_name(file_name) {
+        open(truncate ? std::ios_base::trunc : std::ios_base::app);
+    }
+
+    MLogFileSink(const std::string &file_name, const RotatePolicy &policy)
+        : m_file_name(file_name) {
+        if (open(std::ios_base::app)) m_rotate.start(m_file_name, policy);
+    }
+
+    ~MLogFileSink() override {
+        if (m_ofstream == nullptr) return;
+
+        m_ofstream->flush();
+        m_ofstream->close();
+        m_rotate.stop();
+        MLogFileManager::erase_unique_ofstream(m_file_name);
+    }
+
+    // 文件名重复或者打开失败时返回false，此时所有记录都被丢弃
+    bool is_open() const { return m_ofstream != nullptr; }
+
+    void write(const MLogRecordView &record) override {
+        if (m_ofstream == nullptr) return;
+
+        const std::string_view text = payload(record);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ofstream->write(text.data(), static_cast<std::streamsize>(text.size()));
+        if (record.flush) m_ofstream->flush();
+        if (m_rotate.add(text.size())) m_rotate.rotate(*m_ofstream);
+    }
+
+    void flush() override {
+        if (m_ofstream == nullptr) return;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ofstream->flush();
+    }
+
+private:
+    bool open(std::ios_base::openmode mode) {
+        auto ofstream = MLogFileManager::get_unique_ofstream(m_file_name);
+        if (ofstream == nullptr) return false;
+
+        ofstream->open(MLogFileManager::get_path_prefix() + m_file_name,
+                       std::ios_base::out | mode); // NOLINT(hicpp-signed-bitwise)
+        if (ofstream->fail()) {
+            MLogFileManager::erase_unique_ofstream(m_file_name);
+            return false;
+        }
+        m_ofstream = std::move(ofstream);
+        return true;
+    }
+
+    std::string m_file_name;
+    std::shared_ptr<std::ofstream> m_ofstream;
+    MLogFileManager::Rotator m_rotate;
+    std::mutex m_mutex;
+};
+
+#endif  // MLOGSINK_H_
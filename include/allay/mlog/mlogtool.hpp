@@ -1,11 +1,28 @@
 #ifndef MLOGTOOL_H_
 #define MLOGTOOL_H_
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
 #include <iostream>
 #include <mutex>  // IWYU pragma: keep
+#include <optional>
 #include <regex>
+#include <source_location>
 #include <string>
+#include <version>
+
+// 标准库支持<format>时提供std::format风格的日志接口
+#if defined(__cpp_lib_format)
+#include <format>
+#define MLOG_HAS_FORMAT
+#endif
 
 class MLogTool {
 public:
@@ -28,6 +45,12 @@ public:
         NONE,
     };
 
+    // 文件的编码，结构化记录可以写为JSON Lines
+    enum class Encoding {
+        TEXT = 0,
+        JSON,
+    };
+
     enum class OutType {
         N = 0,
         C,
@@ -43,98 +66,334 @@ public:
         YELLOW,
     };
 
+    // 限流判断的结果，suppressed是上一次通过之后被跳过的次数
+    // 例如 MLOG_RATE_LIMIT(10, 20) { MLOG_WARN("A") << mlog_pass.suppressed; }
+    struct Judgement {
+        bool passed{false};
+        std::size_t suppressed{0};
+
+        explicit operator bool() const { return passed; }
+    };
+
+    // 下面的判断都可以被多个线程同时调用，只使用原子变量，不加锁
+    // suppressed()是累计被跳过的次数
+
     class FirstN {
     private:
         const std::size_t m_first_n;
-        std::size_t m_first_count_n{0};
+        std::atomic<std::size_t> m_first_count_n{0};
+        std::atomic<std::size_t> m_suppressed{0};
 
     public:
         explicit FirstN(std::size_t first_n) : m_first_n(first_n) {}
 
-        bool judge() {
-            if (m_first_count_n < m_first_n) {
-                ++m_first_count_n;
-                return true;
+        // 超过first_n之后不再递增，计数不会溢出
+        Judgement judge() {
+            std::size_t count = m_first_count_n.load(std::memory_order_relaxed);
+            while (count < m_first_n) {
+                if (m_first_count_n.compare_exchange_weak(
+                        count, count + 1, std::memory_order_relaxed)) {
+                    return Judgement{true, 0};
+                }
             }
-            return false;
+            m_suppressed.fetch_add(1, std::memory_order_relaxed);
+            return Judgement{false, 0};
         }
 
-        std::size_t get_count() const { return m_first_count_n; }
+        std::size_t get_count() const {
+            return m_first_count_n.load(std::memory_order_relaxed);
+        }
+
+        std::size_t suppressed() const {
+            return m_suppressed.load(std::memory_order_relaxed);
+        }
     };
 
+    // every_n为0时按1处理，每次都通过
     class EveryN {
     private:
         const std::size_t m_every_n;
-        std::size_t m_every_count_n{0};
+        std::atomic<std::size_t> m_every_count_n{0};
 
     public:
-        explicit EveryN(std::size_t every_n) : m_every_n(every_n) {}
+        explicit EveryN(std::size_t every_n)
+            : m_every_n(std::max<std::size_t>(every_n, 1)) {}
+
+        Judgement judge() {
+            const std::size_t count =
+                m_every_count_n.fetch_add(1, std::memory_order_relaxed);
+            if (count % m_every_n != 0) return Judgement{false, 0};
+            return Judgement{true, count == 0 ? 0 : m_every_n - 1};
+        }
 
-        bool judge() { return ((m_every_count_n++) % m_every_n) == 0; }
+        std::size_t get_count() const {
+            return m_every_count_n.load(std::memory_order_relaxed);
+        }
 
-        std::size_t get_count() const { return m_every_count_n; }
+        std::size_t suppressed() const {
+            const std::size_t count = get_count();
+            return count - (count + m_every_n - 1) / m_every_n;
+        }
     };
 
     class MoreThanN {
     private:
         const std::size_t m_morethan_n;
-        std::size_t m_morethan_count_n{0};
+        std::atomic<std::size_t> m_morethan_count_n{0};
 
     public:
         explicit MoreThanN(std::size_t morethan_n) : m_morethan_n(morethan_n) {}
 
-        bool judge() { return (m_morethan_count_n++ >= m_morethan_n); }
+        Judgement judge() {
+            const std::size_t count =
+                m_morethan_count_n.fetch_add(1, std::memory_order_relaxed);
+            if (count < m_morethan_n) return Judgement{false, 0};
+            return Judgement{true, count == m_morethan_n ? m_morethan_n : 0};
+        }
+
+        std::size_t get_count() const {
+            return m_morethan_count_n.load(std::memory_order_relaxed);
+        }
+
+        std::size_t suppressed() const {
+            return std::min(get_count(), m_morethan_n);
+        }
+    };
+
+    // 被跳过的次数，通过时取出上一次通过之后的次数
+    class SuppressCounter {
+    public:
+        Judgement skip() {
+            m_pending.fetch_add(1, std::memory_order_relaxed);
+            m_total.fetch_add(1, std::memory_order_relaxed);
+            return Judgement{false, 0};
+        }
+
+        Judgement pass() {
+            return Judgement{true,
+                             m_pending.exchange(0, std::memory_order_relaxed)};
+        }
+
+        std::size_t total() const {
+            return m_total.load(std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<std::size_t> m_pending{0};
+        std::atomic<std::size_t> m_total{0};
+    };
+
+    // 每隔至少interval_ms毫秒通过一次，第一次总是通过
+    class EveryMs {
+    public:
+        explicit EveryMs(std::int64_t interval_ms)
+            : m_interval(interval_ms * 1000000) {}
+
+        Judgement judge() {
+            const std::int64_t now = steady_nanoseconds();
+            std::int64_t next = m_next.load(std::memory_order_relaxed);
+            if (now >= next
+                && m_next.compare_exchange_strong(next, now + m_interval,
+                                                  std::memory_order_relaxed)) {
+                return m_counter.pass();
+            }
+            return m_counter.skip();
+        }
+
+        std::size_t suppressed() const { return m_counter.total(); }
+
+    private:
+        const std::int64_t m_interval;  // 纳秒
+        std::atomic<std::int64_t> m_next{0};
+        SuppressCounter m_counter;
+    };
+
+    // 令牌桶，平均每秒per_sec次，最多连续通过burst次
+    // 使用GCRA算法，只用一个原子变量记录理论到达时间
+    // per_sec不是正数时令牌在很长时间内不再补充，只有最初的burst次通过
+    // burst为0时按1处理
+    class RateLimit {
+    public:
+        RateLimit(double per_sec, std::size_t burst)
+            : m_period(period_of(per_sec, burst_of(burst))),
+              m_tolerance(m_period * burst_of(burst)) {}
+
+        Judgement judge() {
+            const std::int64_t now = steady_nanoseconds();
+            std::int64_t tat = m_tat.load(std::memory_order_relaxed);
+            for (;;) {
+                const std::int64_t next = std::max(tat, now) + m_period;
+                if (next - now > m_tolerance) return m_counter.skip();
+                if (m_tat.compare_exchange_weak(tat, next,
+                                                std::memory_order_relaxed)) {
+                    return m_counter.pass();
+                }
+            }
+        }
+
+        std::size_t suppressed() const { return m_counter.total(); }
+
+    private:
+        // 桶的容量不超过max_ns（约31年），计算理论到达时间时不会溢出
+        constexpr static std::int64_t max_ns = 1000000000000000000;
+        constexpr static std::int64_t max_burst = 1000000000;
+
+        static std::int64_t burst_of(std::size_t burst) {
+            return static_cast<std::int64_t>(std::clamp<std::size_t>(
+                burst, 1, static_cast<std::size_t>(max_burst)));
+        }
+
+        static std::int64_t period_of(double per_sec, std::int64_t burst) {
+            const std::int64_t max_period = max_ns / burst;
+            // 包括0、负数和NaN
+            if (!(per_sec * static_cast<double>(max_period) > 1e9)) {
+                return max_period;
+            }
+            return std::max<std::int64_t>(
+                static_cast<std::int64_t>(1e9 / per_sec), 1);
+        }
 
-        std::size_t get_count() const { return m_morethan_count_n; }
+        const std::int64_t m_period;     // 产生一个令牌的纳秒数
+        const std::int64_t m_tolerance;  // 桶的容量对应的纳秒数
+        std::atomic<std::int64_t> m_tat{0};
+        SuppressCounter m_counter;
     };
 
+    // 以概率p通过，使用线程局部的随机数，不同线程之间没有竞争
+    class Sample {
+    public:
+        explicit Sample(double p)
+            : m_always(p >= 1.0),
+              m_threshold(p <= 0.0 || p >= 1.0
+                              ? 0
+                              : static_cast<std::uint64_t>(
+                                    p * 18446744073709551616.0)) {}
+
+        Judgement judge() {
+            if (m_always || thread_random() < m_threshold) {
+                return m_counter.pass();
+            }
+            return m_counter.skip();
+        }
+
+        std::size_t suppressed() const { return m_counter.total(); }
+
+    private:
+        const bool m_always;
+        const std::uint64_t m_threshold;  // 随机数小于它时通过
+        SuppressCounter m_counter;
+    };
+
+    // 线程局部的xorshift64*随机数，用线程局部变量的地址和时间作为种子
+    static std::uint64_t thread_random() {
+        thread_local std::uint64_t state = 0;
+        if (state == 0) {
+            std::uint64_t seed = reinterpret_cast<std::uintptr_t>(&state)
+                                 ^ static_cast<std::uint64_t>(steady_nanoseconds());
+            seed = (seed ^ (seed >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+            seed = (seed ^ (seed >> 27U)) * 0x94d049bb133111ebULL;
+            state = (seed ^ (seed >> 31U)) | 1U;
+        }
+        state ^= state >> 12U;
+        state ^= state << 25U;
+        state ^= state >> 27U;
+        return state * 0x2545f4914f6cdd1dULL;
+    }
+
+    static std::int64_t steady_nanoseconds() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    // 全局日志等级，没有单独设置等级的logger都使用它
     static void set_level(MLogTool::Level level) {
 #ifndef MLOG_USE_MACRO_LEVEL
-        get_level_instance() = level;
+        get_level_instance().store(level, std::memory_order_relaxed);
+        update_level_floor();
 #endif
     }
 
-    static MLogTool::Level &get_level_instance() {
+    static MLogTool::Level get_level() {
+        return get_level_instance().load(std::memory_order_relaxed);
+    }
+
+    static std::atomic<MLogTool::Level> &get_level_instance() {
 #ifndef MLOG_USE_MACRO_LEVEL
-        static MLogTool::Level the_global_level{MLogTool::Level::on};
+        static std::atomic<MLogTool::Level> the_global_level{
+            MLogTool::Level::on};
 #else
-        static MLogTool::Level the_global_level = MLOG_LEVEL;
+        static std::atomic<MLogTool::Level> the_global_level{MLOG_LEVEL};
 #endif
         return the_global_level;
     }
 
-    // 时间戳
-    // 格式例如[2016-06-21 20:54:11:123]
-    static std::string time_stamp() {
-        auto now = std::chrono::system_clock::now();
-        auto now_time_t = std::chrono::system_clock::to_time_t(now);
-        auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                          now.time_since_epoch())
-                      % 1000;
-
-        char buffer[32]{};
-
-        struct tm timeinfo {};
+    // 全局等级和所有logger单独设置的等级中最低的一个
+    // 低于它的日志在任何logger上都不会输出，宏据此跳过参数的求值
+    static MLogTool::Level get_level_floor() {
+        return level_floor().load(std::memory_order_relaxed);
+    }
 
-#if defined(_MSC_VER)
-        localtime_s(&timeinfo, &now_time_t);
-#elif defined(__unix__)
-        localtime_r(&now_time_t, &timeinfo);
-#else
-        static std::mutex mtx;
+    // logger单独设置的等级发生变化时调用，空值表示使用全局等级
+    static void change_logger_level(std::optional<MLogTool::Level> old_level,
+                                    std::optional<MLogTool::Level> new_level) {
         {
-            std::lock_guard<std::mutex> lock(mtx);
-            timeinfo = *localtime(&now_time_t);
+            std::lock_guard<std::mutex> lock(level_mutex());
+            if (old_level) --logger_level_count()[static_cast<std::size_t>(*old_level)];
+            if (new_level) ++logger_level_count()[static_cast<std::size_t>(*new_level)];
         }
-#endif
+        update_level_floor();
+    }
+
+    // 时间戳的小数部分精度
+    enum class TimePrecision {
+        MILLI = 0,  // [2016-06-21 20:54:11.123]
+        MICRO,      // [2016-06-21 20:54:11.123456]
+        NANO,       // [2016-06-21 20:54:11.123456789]
+    };
 
-        std::strftime(static_cast<char *>(buffer), sizeof(buffer),
-                      "[%Y-%m-%d %H:%M:%S", &timeinfo);
+    // 时间戳需要的最大缓冲区长度（含结尾的'\0'）
+    constexpr static std::size_t time_stamp_max_size = 32;
+
+    // 时间戳，写入调用者提供的缓冲区并返回长度，不分配内存
+    // 缓冲区长度至少为time_stamp_max_size
+    // 格式例如[2016-06-21 20:54:11.123]
+    static std::size_t
+    time_stamp(char *buffer, std::chrono::system_clock::time_point now,
+               TimePrecision precision = TimePrecision::MILLI) {
+        auto now_s = std::chrono::floor<std::chrono::seconds>(now);
+        auto frac_ns = static_cast<std::uint32_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(now - now_s)
+                .count());
+
+        // 日期和秒的部分来自缓存，只有秒数变化时才重新格式化
+        const TimeCache &cache =
+            time_cache(std::chrono::system_clock::to_time_t(now_s));
+        std::memcpy(buffer, cache.stamp, 20);
+
+        std::size_t len = 20;
+        buffer[len++] = '.';
+        switch (precision) {
+        case TimePrecision::NANO: len += write_digits(buffer + len, frac_ns, 9); break;
+        case TimePrecision::MICRO:
+            len += write_digits(buffer + len, frac_ns / 1000, 6);
+            break;
+        case TimePrecision::MILLI:
+        default: len += write_digits(buffer + len, frac_ns / 1000000, 3); break;
+        }
+        buffer[len++] = ']';
+        buffer[len] = '\0';
+        return len;
+    }
 
-        std::snprintf(static_cast<char *>(buffer) + 20, 7, ".%03d]",
-                      static_cast<int>(now_ms.count()));
+    static std::size_t time_stamp(char *buffer, TimePrecision precision =
+                                                    TimePrecision::MILLI) {
+        return time_stamp(buffer, std::chrono::system_clock::now(), precision);
+    }
 
-        return std::string{static_cast<char *>(buffer)};
+    static std::string time_stamp() {
+        char buffer[time_stamp_max_size]{};
+        return std::string{static_cast<char *>(buffer), time_stamp(buffer)};
     }
 
     // 等级输出
@@ -158,46 +417,152 @@ public:
     }
 
     // 时间字符串 可用于日志文件名
-    // 例如01-25-21-33
+    // 例如01-25-21-33-05
     static std::string date_string() {
-        auto now = std::chrono::system_clock::now();
-        auto now_time_t = std::chrono::system_clock::to_time_t(now);
+        auto now_s = std::chrono::floor<std::chrono::seconds>(
+            std::chrono::system_clock::now());
+        const struct tm &timeinfo =
+            time_cache(std::chrono::system_clock::to_time_t(now_s)).timeinfo;
+
+        char buffer[16]{};
+        write_digits(buffer, static_cast<std::uint32_t>(timeinfo.tm_mon + 1), 2);
+        buffer[2] = '-';
+        write_digits(buffer + 3, static_cast<std::uint32_t>(timeinfo.tm_mday), 2);
+        buffer[5] = '-';
+        write_digits(buffer + 6, static_cast<std::uint32_t>(timeinfo.tm_hour), 2);
+        buffer[8] = '-';
+        write_digits(buffer + 9, static_cast<std::uint32_t>(timeinfo.tm_min), 2);
+        buffer[11] = '-';
+        write_digits(buffer + 12, static_cast<std::uint32_t>(timeinfo.tm_sec), 2);
+
+        return std::string{static_cast<char *>(buffer), 14};
+    }
+
+    // 判断文件名合法
+    // Windows下文件名中不能包含\/:*?"<>|这些字符
+    // 并且文件名长度这里不允许超过100
+    static bool check_filename_valid(const std::string &file_name) {
+        std::regex reg_express("[\\/:*?\"<>|]");
+        return (!std::regex_search(file_name, reg_express)
+                && (file_name.size() <= 100));
+    }
 
-        char buffer[32]{};
+    // 所有logger共用的控制台锁，保证每条记录在cout上整体写出
+    static std::mutex &console_mutex() {
+        static std::mutex the_console_mutex;
+        return the_console_mutex;
+    }
 
+    // 每个线程缓存最近一次格式化的秒，同一秒内的时间戳只需要补上小数部分
+    struct TimeCache {
+        std::time_t seconds{-1};
         struct tm timeinfo {};
+        char stamp[24]{};  // 例如[2016-06-21 20:54:11，固定20个字符
+    };
+
+    static const TimeCache &time_cache(std::time_t seconds) {
+        thread_local TimeCache cache;
+        if (cache.seconds == seconds) return cache;
 
 #if defined(_MSC_VER)
-        localtime_s(&timeinfo, &now_time_t);
+        localtime_s(&cache.timeinfo, &seconds);
 #elif defined(__unix__)
-        localtime_r(&now_time_t, &timeinfo);
+        localtime_r(&seconds, &cache.timeinfo);
 #else
         static std::mutex mtx;
         {
             std::lock_guard<std::mutex> lock(mtx);
-            timeinfo = *localtime(&now_time_t);
+            cache.timeinfo = *localtime(&seconds);
         }
 #endif
 
-        std::strftime(static_cast<char *>(buffer), sizeof(buffer),
-                      "%m-%d-%H-%M-%S", &timeinfo);
-
-        return std::string{static_cast<char *>(buffer)};
+        std::strftime(static_cast<char *>(cache.stamp), sizeof(cache.stamp),
+                      "[%Y-%m-%d %H:%M:%S", &cache.timeinfo);
+        cache.seconds = seconds;
+        return cache;
     }
 
-    // 判断文件名合法
-    // Windows下文件名中不能包含\/:*?"<>|这些字符
-    // 并且文件名长度这里不允许超过100
-    static bool check_filename_valid(const std::string &file_name) {
-        std::regex reg_express("[\\/:*?\"<>|]");
-        return (!std::regex_search(file_name, reg_express)
-                && (file_name.size() <= 100));
+    // 写入固定位数的十进制数字，不足时补0，返回写入的字符数
+    static std::size_t write_digits(char *buffer, std::uint32_t value,
+                                    std::size_t digits) {
+        for (std::size_t i = digits; i > 0; --i) {
+            buffer[i - 1] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+        return digits;
     }
 
     static void raise_error() {
         std::cerr << "MLog: The program can not perform as expected!";
         exit(1);
     }
+
+private:
+    // 重新计算最低等级，等级的修改很少发生，因此直接加锁
+    static void update_level_floor() {
+        std::lock_guard<std::mutex> lock(level_mutex());
+        Level floor = get_level();
+        for (std::size_t i = 0; i < static_cast<std::size_t>(floor); ++i) {
+            if (logger_level_count()[i] > 0) {
+                floor = static_cast<Level>(i);
+                break;
+            }
+        }
+        level_floor().store(floor, std::memory_order_relaxed);
+    }
+
+    static std::atomic<MLogTool::Level> &level_floor() {
+        static std::atomic<MLogTool::Level> the_level_floor{get_level()};
+        return the_level_floor;
+    }
+
+    // 单独设置为每个等级的logger个数
+    static std::array<int, 6> &logger_level_count() {
+        static std::array<int, 6> the_level_count{};
+        return the_level_count;
+    }
+
+    static std::mutex &level_mutex() {
+        static std::mutex the_level_mutex;
+        return the_level_mutex;
+    }
+};
+
+// 日志调用点的元数据，MLOG_*宏在每个调用点生成一份编译期常量
+// 记录只保存指向它的指针，在写出时才决定如何呈现
+// 函数名由宏传入__func__，只有名字而不是source_location给出的完整签名
+struct MLogSite {
+    const char *file;
+    const char *function;
+    std::uint_least32_t line;
+    MLogTool::Level level;
+
+    constexpr MLogSite(const std::source_location &loc, const char *func,
+                       MLogTool::Level site_level = MLogTool::Level::on)
+        : file(loc.file_name()), function(func), line(loc.line()),
+          level(site_level) {}
+
+    // 默认的文本形式
+    // 例如[main.cpp main 12]
+    void render(std::string &out) const {
+        char line_buffer[16];
+        auto result = std::to_chars(static_cast<char *>(line_buffer),
+                                    static_cast<char *>(line_buffer) + 16, line);
+
+        out.push_back('[');
+        out.append(file).push_back(' ');
+        out.append(function).push_back(' ');
+        out.append(static_cast<char *>(line_buffer), result.ptr);
+        out.append("]\n");
+    }
+
+    // 在pos处插入文本形式
+    void render_at(std::string &out, std::size_t pos) const {
+        thread_local std::string tmp;
+        tmp.clear();
+        render(tmp);
+        out.insert(pos, tmp);
+    }
 };
 
 #endif  // MLOGTOOL_H_
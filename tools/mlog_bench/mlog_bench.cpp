@@ -0,0 +1,235 @@
+#include "allay/cmd_parser/cmd_parser.hpp"
+#include "allay/mlog/mlog.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 日志的吞吐量和单次调用延迟的基准测试，结果写为JSON便于比较不同版本
+// 用法: mlog_bench [-n records] [-t max_threads] [-o output.json] [-d log_dir]
+// cout的测试会向标准输出写入大量内容，通常重定向到/dev/null
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Case {
+    std::string name;    // cout, file, disabled
+    std::string format;  // LogStartFormat的名称
+    std::string mode;    // sync或者async
+    int threads{1};
+};
+
+struct Result {
+    Case bench_case;
+    std::size_t records{0};
+    double seconds{0};
+    std::uint64_t p50{0};
+    std::uint64_t p99{0};
+    std::uint64_t p999{0};
+    std::uint64_t max{0};
+};
+
+struct FormatName {
+    mlog::Format format;
+    const char *name;
+};
+
+constexpr FormatName formats[] = {
+    {mlog::Format::LEVEL_SIGNATURE_TIME, "LEVEL_SIGNATURE_TIME"},
+    {mlog::Format::LEVEL_SIGNATURE, "LEVEL_SIGNATURE"},
+    {mlog::Format::LEVEL_TIME, "LEVEL_TIME"},
+    {mlog::Format::LEVEL, "LEVEL"},
+    {mlog::Format::LEVEL_COLOR, "LEVEL_COLOR"},
+    {mlog::Format::NONE, "NONE"},
+};
+
+// 每个线程写records条记录，记录每次调用的耗时（包含一次计时的开销）
+// 异步模式下计时包括等待后台线程写完
+Result run(const Case &bench_case, mlog::LoggerHandle logger, bool enabled,
+           std::size_t records) {
+    const auto threads = static_cast<std::size_t>(bench_case.threads);
+    std::vector<std::vector<std::uint64_t>> latencies(threads);
+    for (auto &latency : latencies) latency.resize(records);
+
+    const auto produce = [&](std::size_t t) {
+        auto &latency = latencies[t];
+        for (std::size_t i = 0; i < records; ++i) {
+            const auto start = Clock::now();
+            if (enabled) {
+                mlog::info(logger) << " bench " << i << " value " << 3.25
+                                   << '\n';
+            }
+            else {
+                mlog::debug(logger) << " bench " << i << " value " << 3.25
+                                    << '\n';
+            }
+            latency[i] = static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    Clock::now() - start)
+                    .count());
+        }
+    };
+
+    const auto start = Clock::now();
+    if (threads == 1) { produce(0); }
+    else {
+        std::vector<std::thread> workers;
+        for (std::size_t t = 0; t < threads; ++t) workers.emplace_back(produce, t);
+        for (auto &worker : workers) worker.join();
+    }
+    logger->flush();
+    const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    std::vector<std::uint64_t> all;
+    all.reserve(records * threads);
+    for (const auto &latency : latencies) {
+        all.insert(all.end(), latency.begin(), latency.end());
+    }
+    std::ranges::sort(all);
+
+    const auto percentile = [&all](double p) {
+        const auto index = static_cast<std::size_t>(
+            p * static_cast<double>(all.size() - 1));
+        return all[index];
+    };
+
+    return Result{bench_case,    all.size(),       elapsed.count(),
+                  percentile(0.5), percentile(0.99), percentile(0.999),
+                  all.back()};
+}
+
+void write_json(std::ostream &os, const std::vector<Result> &results,
+                std::size_t records, int max_threads) {
+    std::string json = "{\"records\":" + std::to_string(records)
+                       + ",\"max_threads\":" + std::to_string(max_threads)
+                       + ",\"results\":[";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const Result &result = results[i];
+        const double rate =
+            result.seconds > 0 ? static_cast<double>(result.records) / result.seconds
+                               : 0;
+        json.append(i == 0 ? "\n" : ",\n").append("{\"name\":");
+        MLogJson::append_string(json, result.bench_case.name);
+        MLogJson::append_key(json, "format");
+        MLogJson::append_string(json, result.bench_case.format);
+        MLogJson::append_key(json, "mode");
+        MLogJson::append_string(json, result.bench_case.mode);
+        MLogJson::append_key(json, "threads");
+        MLogJson::append_json(json, result.bench_case.threads);
+        MLogJson::append_key(json, "records");
+        MLogJson::append_json(json, result.records);
+        MLogJson::append_key(json, "seconds");
+        MLogJson::append_json(json, result.seconds);
+        MLogJson::append_key(json, "records_per_sec");
+        MLogJson::append_json(json, rate);
+        json.append(",\"latency_ns\":{\"p50\":");
+        MLogJson::append_json(json, result.p50);
+        MLogJson::append_key(json, "p99");
+        MLogJson::append_json(json, result.p99);
+        MLogJson::append_key(json, "p99.9");
+        MLogJson::append_json(json, result.p999);
+        MLogJson::append_key(json, "max");
+        MLogJson::append_json(json, result.max);
+        json.append("}}");
+    }
+    json.append("\n]}\n");
+    os << json;
+}
+
+void report(const Result &result) {
+    std::cerr << result.bench_case.name << ' ' << result.bench_case.format
+              << ' ' << result.bench_case.mode << " threads="
+              << result.bench_case.threads << " rate="
+              << static_cast<std::uint64_t>(static_cast<double>(result.records)
+                                            / result.seconds)
+              << "/s p50=" << result.p50 << "ns p99=" << result.p99
+              << "ns p99.9=" << result.p999 << "ns max=" << result.max
+              << "ns\n";
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    auto parser = CmdParser{};
+    parser.add_option<int>({"-n", "--records"}, "records per case", false,
+                           100000, [](int arg) { return arg > 0; });
+    parser.add_option<int>(
+        {"-t", "--threads"}, "max producer threads", false,
+        static_cast<int>(std::max(2U, std::thread::hardware_concurrency())),
+        [](int arg) { return arg > 0; });
+    parser.add_option<std::string>({"-o", "--output"}, "json output file",
+                                   false, std::string{"mlog_bench.json"});
+    parser.add_option<std::string>({"-d", "--dir"}, "directory of log files",
+                                   false, std::string{"./.mlog_bench/"});
+    parser.parse_check(argc, argv);
+
+    const auto records =
+        static_cast<std::size_t>(parser.get_option<int>("--records").value());
+    const int max_threads = parser.get_option<int>("--threads").value();
+
+    mlog::init(parser.get_option<std::string>("--dir").value());
+    mlog::set_level_info();
+
+    std::vector<Result> results;
+    int logger_id = 0;
+    const auto bench = [&](Case bench_case, mlog::Format format, bool to_file,
+                           bool enabled) {
+        const std::string name = "bench" + std::to_string(logger_id++);
+        auto &logger = mlog::create_logger(name).set_format(format);
+        if (to_file) logger.link_file_trunc("bench.log");
+
+        // 总记录数固定，平均分给每个线程
+        const std::size_t per_thread =
+            std::max<std::size_t>(1, records
+                                         / static_cast<std::size_t>(
+                                             bench_case.threads));
+        results.push_back(run(bench_case, logger, enabled, per_thread));
+        report(results.back());
+
+        logger.link_none();
+    };
+
+    // 被等级过滤的记录，和输出目标无关
+    bench({"disabled", "LEVEL_SIGNATURE", "sync", 1},
+          mlog::Format::LEVEL_SIGNATURE, true, false);
+
+    for (const auto &[format, format_name] : formats) {
+        bench({"cout", format_name, "sync", 1}, format, false, true);
+        bench({"file", format_name, "sync", 1}, format, true, true);
+    }
+
+    mlog::init_async(1U << 16U, mlog::OverflowPolicy::BLOCK);
+    for (const auto &[format, format_name] : formats) {
+        bench({"file", format_name, "async", 1}, format, true, true);
+    }
+    mlog::shutdown_async();
+
+    // 多个生产者：1, 2, 4 ... max_threads
+    for (const char *mode : {"sync", "async"}) {
+        if (std::string{mode} == "async") {
+            mlog::init_async(1U << 16U, mlog::OverflowPolicy::BLOCK);
+        }
+        for (int threads = 1; threads <= max_threads;
+             threads = (threads * 2 > max_threads && threads < max_threads)
+                           ? max_threads
+                           : threads * 2) {
+            bench({"file", "LEVEL_SIGNATURE_TIME", mode, threads},
+                  mlog::Format::LEVEL_SIGNATURE_TIME, true, true);
+        }
+    }
+    mlog::shutdown_async();
+
+    const std::string output = parser.get_option<std::string>("--output").value();
+    std::ofstream fout(output, std::ios_base::trunc);
+    if (!fout.is_open()) {
+        std::cerr << "mlog_bench: cannot open " << output << '\n';
+        return 1;
+    }
+    write_json(fout, results, records, max_threads);
+    return 0;
+}
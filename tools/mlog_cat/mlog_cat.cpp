@@ -0,0 +1,48 @@
+#include "allay/mlog/mlogcompress.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// 把分块压缩的日志（MLogCompressedSink）还原为文本
+// 用法: mlog_cat <file> [output] [skip_blocks]，省略output或者output为-时输出到标准输出
+// 损坏的块被跳过，其余的块照常输出
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 4) {
+        std::cerr << "usage: mlog_cat <file> [output] [skip_blocks]\n";
+        return 2;
+    }
+
+    std::ifstream fin(argv[1], std::ios_base::binary);
+    if (!fin.is_open()) {
+        std::cerr << "mlog_cat: cannot open " << argv[1] << '\n';
+        return 1;
+    }
+
+    const bool use_file = argc >= 3 && std::string{argv[2]} != "-";
+    std::ofstream fout;
+    if (use_file) {
+        fout.open(argv[2], std::ios_base::trunc | std::ios_base::binary); // NOLINT(hicpp-signed-bitwise)
+        if (!fout.is_open()) {
+            std::cerr << "mlog_cat: cannot open " << argv[2] << '\n';
+            return 1;
+        }
+    }
+
+    std::size_t skip_blocks = 0;
+    if (argc == 4) {
+        try {
+            skip_blocks = std::stoul(argv[3]);
+        }
+        catch (const std::exception &) {
+            std::cerr << "mlog_cat: invalid block count " << argv[3] << '\n';
+            return 2;
+        }
+    }
+
+    if (!MLogLz::decode(fin, use_file ? fout : std::cout, skip_blocks)) {
+        std::cerr << "mlog_cat: " << argv[1] << " is corrupted or truncated\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+#include "allay/mlog/mlogbinary.hpp"
+
+#include <fstream>
+#include <iostream>
+
+// 把二进制日志还原为文本日志
+// 用法: mlog_decode <file> [output]，省略output时输出到标准输出
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "usage: mlog_decode <file> [output]\n";
+        return 2;
+    }
+
+    std::ifstream fin(argv[1], std::ios_base::binary);
+    if (!fin.is_open()) {
+        std::cerr << "mlog_decode: cannot open " << argv[1] << '\n';
+        return 1;
+    }
+
+    std::ofstream fout;
+    if (argc == 3) {
+        fout.open(argv[2], std::ios_base::trunc);
+        if (!fout.is_open()) {
+            std::cerr << "mlog_decode: cannot open " << argv[2] << '\n';
+            return 1;
+        }
+    }
+
+    if (!MLogBinary::decode(fin, (argc == 3) ? fout : std::cout)) {
+        std::cerr << "mlog_decode: " << argv[1] << " is corrupted or truncated\n";
+        return 1;
+    }
+    return 0;
+}
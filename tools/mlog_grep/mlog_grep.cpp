@@ -0,0 +1,541 @@
+#include "allay/cmd_parser/cmd_parser.hpp"
+#include "allay/mlog/mlogtool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MLOG_GREP_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// 并行搜索MLogger写出的文本日志
+// 用法: mlog_grep [-l level] [-n name] [--from time] [--to time] [-s text] [-j threads] [-c] files...
+// 例如 mlog_grep -l warn -n net --from "2016-06-21 20:54" --to "2016-06-21 21:04" -s timeout a.log
+//
+// 文件通过mmap映射，按行对齐切分为若干块，由所有线程并行扫描，结果按照原来的顺序输出
+// 记录开头可以是任意一种LogStartFormat：[LEVEL]{name}[time]、[LEVEL]{name}、[LEVEL][time]、
+// [LEVEL]（包括cout上着色的开头），NONE格式的行没有开头，只能按内容筛选
+// 按记录筛选：没有开头的行属于上一条有开头的记录，例如MLOG_*宏在调用点之后一行的消息
+// 等级、名称和时间使用这条记录的开头，内容可以出现在记录的任何一行，匹配时输出整条记录
+// 文件开头、第一条有开头的记录之前的行各自作为一条没有开头的记录
+// 时间按字符串比较，--from和--to可以只写到分钟或者秒，--to包含这一整分钟或者整秒
+namespace {
+
+using Level = MLogTool::Level;
+
+struct Filter {
+    std::optional<Level> min_level;  // 不低于这个等级，不包括logger自己的提示
+    std::string name;                // 为空时不按名称筛选
+    std::string from;                // 为空时不限制
+    std::string to;
+    std::string text;  // 为空时不按内容筛选
+
+    bool needs_prefix() const {
+        return min_level.has_value() || !name.empty() || !from.empty()
+               || !to.empty();
+    }
+};
+
+// 一行的开头，缺少的部分为空
+struct Prefix {
+    std::optional<Level> level;
+    std::string_view name;
+    std::string_view time;
+};
+
+// 等级戳来自MLogTool，与写日志时完全一致
+const std::array<std::pair<std::string, Level>, 6> &level_stamps() {
+    static const std::array<std::pair<std::string, Level>, 6> the_stamps{{
+        {MLogTool::level_stamp(Level::debug), Level::debug},
+        {MLogTool::level_stamp(Level::info), Level::info},
+        {MLogTool::level_stamp(Level::warn), Level::warn},
+        {MLogTool::level_stamp(Level::error), Level::error},
+        {MLogTool::level_stamp(Level::on), Level::on},
+        {MLogTool::level_stamp(Level::off), Level::off},
+    }};
+    return the_stamps;
+}
+
+// 跳过一个ANSI颜色序列，例如\x1b[92m
+void skip_color(std::string_view &line) {
+    if (line.size() < 2 || line[0] != '\x1b' || line[1] != '[') return;
+    const std::size_t end = line.find('m');
+    if (end != std::string_view::npos) line.remove_prefix(end + 1);
+}
+
+Prefix parse_prefix(std::string_view line) {
+    Prefix result;
+
+    skip_color(line);
+    for (const auto &[stamp, level] : level_stamps()) {
+        if (line.starts_with(stamp)) {
+            result.level = level;
+            line.remove_prefix(stamp.size());
+            break;
+        }
+    }
+    if (!result.level.has_value()) return result;
+    skip_color(line);
+
+    if (line.starts_with('{')) {
+        const std::size_t end = line.find('}');
+        if (end == std::string_view::npos) return result;
+        result.name = line.substr(1, end - 1);
+        line.remove_prefix(end + 1);
+    }
+
+    // 时间戳形如[2016-06-21 20:54:11.123]
+    if (line.size() > 20 && line[0] == '[' && line[5] == '-' && line[11] == ' ') {
+        const std::size_t end = line.find(']');
+        if (end != std::string_view::npos) result.time = line.substr(1, end - 1);
+    }
+    return result;
+}
+
+bool match_prefix(std::string_view line, const Filter &filter) {
+    if (!filter.needs_prefix()) return true;
+
+    const Prefix prefix = parse_prefix(line);
+    if (filter.min_level.has_value()
+        && (!prefix.level.has_value() || *prefix.level == Level::off
+            || *prefix.level < *filter.min_level)) {
+        return false;
+    }
+    if (!filter.name.empty() && prefix.name != filter.name) return false;
+    if (!filter.from.empty() && (prefix.time.empty() || prefix.time < filter.from)) {
+        return false;
+    }
+    if (!filter.to.empty()
+        && (prefix.time.empty() || prefix.time.substr(0, filter.to.size()) > filter.to)) {
+        return false;
+    }
+    return true;
+}
+
+using Searcher = std::boyer_moore_horspool_searcher<std::string_view::const_iterator>;
+
+// 从pos开始的一行，不含换行符
+std::string_view line_at(std::string_view data, std::size_t pos) {
+    const std::size_t end = data.find('\n', pos);
+    return data.substr(pos, (end == std::string_view::npos) ? end : end - pos);
+}
+
+// 有开头的行是一条记录的开始
+bool is_record_start(std::string_view data, std::size_t pos) {
+    return parse_prefix(line_at(data, pos)).level.has_value();
+}
+
+// pos所在行之后的下一条记录的开始，没有时返回data.size()
+std::size_t next_record(std::string_view data, std::size_t pos) {
+    for (;;) {
+        pos = data.find('\n', pos);
+        if (pos == std::string_view::npos || pos + 1 >= data.size()) {
+            return data.size();
+        }
+        ++pos;
+        if (is_record_start(data, pos)) return pos;
+    }
+}
+
+// pos所在的记录的开始，不早于begin
+std::size_t record_begin(std::string_view data, std::size_t begin,
+                         std::size_t pos) {
+    for (;;) {
+        const std::size_t newline = (pos > begin) ? data.rfind('\n', pos - 1)
+                                                  : std::string_view::npos;
+        pos = (newline == std::string_view::npos || newline < begin)
+                  ? begin
+                  : newline + 1;
+        if (pos == begin || is_record_start(data, pos)) return pos;
+        --pos;
+    }
+}
+
+// 最后一条记录的开始，data以一条记录开始
+std::size_t last_record(std::string_view data) {
+    std::size_t end = data.size();
+    while (end > 0) {
+        const std::size_t newline =
+            (end >= 2) ? data.rfind('\n', end - 2) : std::string_view::npos;
+        const std::size_t begin =
+            (newline == std::string_view::npos) ? 0 : newline + 1;
+        if (begin == 0 || is_record_start(data, begin)) return begin;
+        end = begin;
+    }
+    return 0;
+}
+
+// 一条记录（可以有多行）是否满足条件，开头只看第一行
+bool match_record(std::string_view record, const Filter &filter,
+                  const Searcher *searcher) {
+    if (!match_prefix(line_at(record, 0), filter)) return false;
+    return searcher == nullptr
+           || (*searcher)(record.begin(), record.end()).first != record.end();
+}
+
+// 输出一条记录，多个文件时每一行都加上文件名
+void emit_record(std::string_view record, std::string_view file_prefix,
+                 std::string &out) {
+    while (!record.empty()) {
+        const std::string_view line = line_at(record, 0);
+        out.append(file_prefix).append(line).push_back('\n');
+        record.remove_prefix(std::min(line.size() + 1, record.size()));
+    }
+}
+
+struct Output {
+    std::string_view file_prefix;
+    bool count_only{false};
+};
+
+std::size_t check_record(std::string_view record, const Filter &filter,
+                         const Searcher *searcher, const Output &output,
+                         std::string &out) {
+    if (!match_record(record, filter, searcher)) return 0;
+    if (!output.count_only) emit_record(record, output.file_prefix, out);
+    return 1;
+}
+
+// 扫描若干条完整的记录，data以一条记录开始，匹配的记录追加到out，返回匹配的记录数
+// 只按内容筛选时先查找内容，再找到所在的记录，不需要逐条比较
+std::size_t scan_records(std::string_view data, const Filter &filter,
+                         const Searcher *searcher, const Output &output,
+                         std::string &out) {
+    std::size_t count = 0;
+    std::size_t pos = 0;
+    while (pos < data.size()) {
+        std::size_t begin = pos;
+        if (searcher != nullptr && !filter.needs_prefix()) {
+            const auto hit =
+                (*searcher)(data.begin() + static_cast<std::ptrdiff_t>(pos),
+                            data.end())
+                    .first;
+            if (hit == data.end()) break;
+            begin = record_begin(data, pos,
+                                 static_cast<std::size_t>(hit - data.begin()));
+        }
+
+        const std::size_t end = next_record(data, begin);
+        count += check_record(data.substr(begin, end - begin), filter, searcher,
+                              output, out);
+        pos = end;
+    }
+    return count;
+}
+
+// 扫描一些没有开头的行，每一行作为一条记录
+std::size_t scan_lines(std::string_view data, const Filter &filter,
+                       const Searcher *searcher, const Output &output,
+                       std::string &out) {
+    if (filter.needs_prefix()) return 0;
+
+    std::size_t count = 0;
+    while (!data.empty()) {
+        const std::string_view line = line_at(data, 0);
+        count += check_record(line, filter, searcher, output, out);
+        data.remove_prefix(std::min(line.size() + 1, data.size()));
+    }
+    return count;
+}
+
+// 只读映射的文件，不支持mmap的平台上读入内存
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+#ifdef MLOG_GREP_HAS_MMAP
+        if (m_data != nullptr) ::munmap(m_data, m_size);
+#endif
+    }
+
+    bool open(const std::string &path) {
+#ifdef MLOG_GREP_HAS_MMAP
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC); // NOLINT(hicpp-signed-bitwise)
+        if (fd < 0) return false;
+
+        struct stat st {};
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        m_size = static_cast<std::size_t>(st.st_size);
+        if (m_size > 0) {
+            void *data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                ::close(fd);
+                return false;
+            }
+            ::madvise(data, m_size, MADV_SEQUENTIAL);
+            m_data = data;
+        }
+        ::close(fd);
+        return true;
+#else
+        std::ifstream fin(path, std::ios_base::binary);
+        if (!fin.is_open()) return false;
+        std::stringstream ss;
+        ss << fin.rdbuf();
+        m_content = ss.str();
+        return true;
+#endif
+    }
+
+    // 忽略末尾的0字节：mmap写入的日志在崩溃后没有截断，末尾是预分配的空间
+    std::string_view view() const {
+#ifdef MLOG_GREP_HAS_MMAP
+        std::string_view data{static_cast<const char *>(m_data), m_size};
+#else
+        std::string_view data = m_content;
+#endif
+        while (!data.empty() && data.back() == '\0') data.remove_suffix(1);
+        return data;
+    }
+
+private:
+#ifdef MLOG_GREP_HAS_MMAP
+    void *m_data{nullptr};
+    std::size_t m_size{0};
+#else
+    std::string m_content;
+#endif
+};
+
+struct Chunk {
+    std::size_t file{0};
+    std::string_view data;
+};
+
+// 一块的扫描结果，主线程按顺序等待并输出
+// 块的边界不一定是记录的边界：块开头没有开头的行（leading）可能属于上一块的最后一条记录，
+// 块的最后一条记录（tail）可能在下一块继续，这两部分由主线程拼接之后再判断
+struct ChunkResult {
+    std::string_view leading;  // 第一条记录之前的行，没有记录时是整个块
+    std::string leading_out;   // 把leading的每一行作为单独的记录（文件中还没有出现过记录时）
+    std::size_t leading_count{0};
+    std::string out;  // 中间的完整记录
+    std::size_t count{0};
+    std::string_view tail;  // 最后一条记录，没有记录时为空
+    std::atomic<bool> done{false};
+};
+
+void scan_chunk(std::string_view chunk, const Filter &filter,
+                const Searcher *searcher, const Output &output,
+                ChunkResult &result) {
+    const std::size_t first =
+        (chunk.empty() || is_record_start(chunk, 0)) ? 0 : next_record(chunk, 0);
+    result.leading = chunk.substr(0, first);
+    result.leading_count =
+        scan_lines(result.leading, filter, searcher, output, result.leading_out);
+
+    const std::string_view records = chunk.substr(first);
+    if (records.empty()) return;
+
+    const std::size_t tail = last_record(records);
+    result.count = scan_records(records.substr(0, tail), filter, searcher,
+                                output, result.out);
+    result.tail = records.substr(tail);
+}
+
+// 按行对齐切分，除了最后一块，每块至少chunk_size字节
+void split(std::size_t file, std::string_view data, std::size_t chunk_size,
+           std::vector<Chunk> &chunks) {
+    while (!data.empty()) {
+        std::size_t end = std::min(chunk_size, data.size());
+        if (end < data.size()) {
+            const std::size_t newline = data.find('\n', end - 1);
+            end = (newline == std::string_view::npos) ? data.size() : newline + 1;
+        }
+        chunks.push_back(Chunk{file, data.substr(0, end)});
+        data.remove_prefix(end);
+    }
+}
+
+std::optional<Level> parse_level(const std::string &name) {
+    if (name == "debug") return Level::debug;
+    if (name == "info") return Level::info;
+    if (name == "warn") return Level::warn;
+    if (name == "error") return Level::error;
+    return std::nullopt;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+    auto parser = CmdParser{};
+    parser.add_option<std::string>(
+        {"-l", "--level"}, "minimum level: debug, info, warn or error", false,
+        std::string{},
+        [](const std::string &arg) { return parse_level(arg).has_value(); });
+    parser.add_option<std::string>({"-n", "--name"}, "logger name", false,
+                                   std::string{});
+    parser.add_option<std::string>({"-f", "--from"},
+                                   "earliest time, e.g. \"2016-06-21 20:54\"",
+                                   false, std::string{});
+    parser.add_option<std::string>({"-t", "--to"}, "latest time (inclusive)",
+                                   false, std::string{});
+    parser.add_option<std::string>({"-s", "--search"}, "substring to search",
+                                   false, std::string{});
+    parser.add_option<int>(
+        {"-j", "--jobs"}, "number of threads", false,
+        static_cast<int>(std::max(1U, std::thread::hardware_concurrency())),
+        [](int arg) { return arg > 0; });
+    parser.add_flag({"-c", "--count"}, "print only the number of matching records");
+    parser.parse_check(argc, argv);
+
+    Filter filter;
+    const std::string level_name = parser.get_option<std::string>("--level").value();
+    if (!level_name.empty()) filter.min_level = parse_level(level_name);
+    filter.name = parser.get_option<std::string>("--name").value();
+    filter.from = parser.get_option<std::string>("--from").value();
+    filter.to = parser.get_option<std::string>("--to").value();
+    filter.text = parser.get_option<std::string>("--search").value();
+    const auto jobs = static_cast<std::size_t>(parser.get_option<int>("--jobs").value());
+    const bool count_only = parser.get_count("--count").value_or(0) > 0;
+
+    const std::vector<std::string> &paths = parser.get_rest();
+    if (paths.empty()) {
+        std::cerr << "mlog_grep: no input file\n";
+        return 2;
+    }
+
+    std::vector<std::unique_ptr<MappedFile>> files;
+    std::vector<std::string> file_prefixes;
+    std::size_t total = 0;
+    for (const std::string &path : paths) {
+        files.push_back(std::make_unique<MappedFile>());
+        if (!files.back()->open(path)) {
+            std::cerr << "mlog_grep: cannot open " << path << '\n';
+            return 2;
+        }
+        file_prefixes.push_back(paths.size() > 1 ? path + ":" : std::string{});
+        total += files.back()->view().size();
+    }
+
+    // 每个线程大约分到8块，块的大小在1 MiB到64 MiB之间
+    const std::size_t chunk_size = std::clamp<std::size_t>(
+        total / (jobs * 8), std::size_t{1} << 20U, std::size_t{64} << 20U);
+    std::vector<Chunk> chunks;
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        split(i, files[i]->view(), chunk_size, chunks);
+    }
+
+    std::optional<Searcher> searcher;
+    if (!filter.text.empty()) {
+        searcher.emplace(filter.text.data(),
+                         filter.text.data() + filter.text.size());
+    }
+
+    const Searcher *searcher_ptr = searcher.has_value() ? &*searcher : nullptr;
+
+    // 工作线程最多领先输出window块，限制缓存的结果
+    const std::size_t window = jobs * 4;
+    auto results = std::make_unique<ChunkResult[]>(chunks.size());
+    std::atomic<std::size_t> next{0};
+    std::atomic<std::size_t> printed{0};
+
+    const auto work = [&]() {
+        for (;;) {
+            const std::size_t index = next.fetch_add(1);
+            if (index >= chunks.size()) return;
+            for (std::size_t seen = printed.load(); index >= seen + window;
+                 seen = printed.load()) {
+                printed.wait(seen);
+            }
+
+            const Chunk &chunk = chunks[index];
+            ChunkResult &result = results[index];
+            scan_chunk(chunk.data, filter, searcher_ptr,
+                       Output{file_prefixes[chunk.file], count_only}, result);
+            result.done.store(true, std::memory_order_release);
+            result.done.notify_one();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < std::min(jobs, chunks.size()); ++t) {
+        threads.emplace_back(work);
+    }
+
+    const auto write = [](const std::string &text) {
+        std::cout.write(text.data(), static_cast<std::streamsize>(text.size()));
+    };
+
+    // pending是跨越块边界、还没有结束的记录，它的各部分在映射的文件中是连续的
+    std::size_t matched = 0;
+    std::string_view pending;
+    bool has_pending = false;
+    std::string pending_out;
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+        ChunkResult &result = results[i];
+        result.done.wait(false, std::memory_order_acquire);
+
+        const Chunk &chunk = chunks[i];
+        const Output output{file_prefixes[chunk.file], count_only};
+        if (i == 0 || chunks[i - 1].file != chunk.file) has_pending = false;
+
+        if (has_pending) {
+            pending = std::string_view{
+                pending.data(), static_cast<std::size_t>(
+                                    result.leading.data()
+                                    + result.leading.size() - pending.data())};
+        }
+        else {
+            matched += result.leading_count;
+            write(result.leading_out);
+        }
+
+        if (!result.tail.empty()) {
+            if (has_pending) {
+                matched += check_record(pending, filter, searcher_ptr, output,
+                                        pending_out);
+            }
+            write(pending_out);
+            pending_out.clear();
+            matched += result.count;
+            write(result.out);
+            pending = result.tail;
+            has_pending = true;
+        }
+
+        if (i + 1 == chunks.size() || chunks[i + 1].file != chunk.file) {
+            if (has_pending) {
+                matched += check_record(pending, filter, searcher_ptr, output,
+                                        pending_out);
+            }
+            write(pending_out);
+            pending_out.clear();
+            has_pending = false;
+        }
+
+        std::string{}.swap(result.leading_out);
+        std::string{}.swap(result.out);
+        printed.store(i + 1);
+        printed.notify_all();
+    }
+    for (auto &thread : threads) thread.join();
+
+    if (count_only) std::cout << matched << '\n';
+    std::cout.flush();
+    return matched > 0 ? 0 : 1;
+}